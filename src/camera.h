@@ -25,8 +25,6 @@ public:
 		: position(cameraPos)
 		, front(cameraFront)
 		, worldUp(cameraUp)
-		, m_DeltaTime(0.0f)
-		, m_LastFrame(0.0f)
 		, m_MovementSpeed(SPEED)
 		, m_MouseSensity(SENSITIVY)
 		, m_Zoom(ZOOM)
@@ -43,7 +41,39 @@ public:
 
 	glm::mat4 getViewMatrix() const
 	{
-		return glm::lookAt(this->position, this->position + this->front, this->up);
+		return this->getViewMatrix(this->position);
+	}
+
+	// View from an interpolated eye position, the orientation is the current one
+	glm::mat4 getViewMatrix(const glm::vec3& eye) const
+	{
+		return glm::lookAt(eye, eye + this->front, this->up);
+	}
+
+	float getYaw() const
+	{
+		return this->m_Yaw;
+	}
+
+	float getPitch() const
+	{
+		return this->m_Pitch;
+	}
+
+	// The renderer applies the polygon mode, the camera only holds the toggle
+	bool isWireframe() const
+	{
+		return this->m_WireframeMode;
+	}
+
+	// Used to replay recorded fly-throughs
+	void setPose(glm::vec3 cameraPos, float yaw, float pitch, float zoom)
+	{
+		this->position = cameraPos;
+		this->m_Yaw = yaw;
+		this->m_Pitch = pitch;
+		this->m_Zoom = zoom;
+		this->updateCameraVectors();
 	}
 
 	void processKeyboard(GLFWwindow* window)
@@ -55,24 +85,14 @@ public:
 		
 		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
 		{
-			if (m_WireframeMode == false)
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-				this->m_WireframeMode = true;
-			}
-			else
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-				this->m_WireframeMode = false;
-			}
+			this->m_WireframeMode = !this->m_WireframeMode;
 		}
+	}
 
-		// Calculate de delta time in order to make a smooth moviment
-		float currentFrame = (float)glfwGetTime();
-		this->m_DeltaTime = currentFrame - this->m_LastFrame;
-		this->m_LastFrame = currentFrame;
-
-		const float cameraSpeed = this->m_MovementSpeed * m_DeltaTime;
+	// One simulation step of the WASD movement, deltaTime comes from the FrameClock
+	void processMovement(GLFWwindow* window, float deltaTime)
+	{
+		const float cameraSpeed = this->m_MovementSpeed * deltaTime;
 
 		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 			position += cameraSpeed * front;
@@ -154,8 +174,6 @@ public:
 	}
 
 private:
-	float m_DeltaTime;
-	float m_LastFrame;
 	float m_MouseSensity;
 
 	float m_MovementSpeed;
@@ -0,0 +1,91 @@
+#include "fly_through.h"
+
+#include <fstream>
+
+FlyThrough::FlyThrough()
+	: m_Frame(0)
+	, m_Recording(false)
+	, m_Playing(false)
+{
+}
+
+void FlyThrough::startRecording()
+{
+	this->m_Poses.clear();
+	this->m_Recording = true;
+	this->m_Playing = false;
+}
+
+bool FlyThrough::stopRecording(const std::string& path)
+{
+	this->m_Recording = false;
+
+	std::ofstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	for (const CameraPose& pose : this->m_Poses)
+	{
+		file << pose.position.x << " " << pose.position.y << " " << pose.position.z << " "
+			<< pose.yaw << " " << pose.pitch << " " << pose.zoom << "\n";
+	}
+
+	return file.good();
+}
+
+bool FlyThrough::startPlayback(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	this->m_Poses.clear();
+
+	CameraPose pose {};
+	while (file >> pose.position.x >> pose.position.y >> pose.position.z >> pose.yaw >> pose.pitch >> pose.zoom)
+	{
+		this->m_Poses.push_back(pose);
+	}
+
+	this->m_Frame = 0;
+	this->m_Recording = false;
+	this->m_Playing = !this->m_Poses.empty();
+
+	return this->m_Playing;
+}
+
+bool FlyThrough::isRecording() const
+{
+	return this->m_Recording;
+}
+
+bool FlyThrough::isPlaying() const
+{
+	return this->m_Playing;
+}
+
+void FlyThrough::record(const Camera& camera)
+{
+	if (this->m_Recording)
+	{
+		this->m_Poses.push_back({ camera.position, camera.getYaw(), camera.getPitch(), camera.m_Zoom });
+	}
+}
+
+bool FlyThrough::play(Camera& camera)
+{
+	if (!this->m_Playing || this->m_Frame >= this->m_Poses.size())
+	{
+		this->m_Playing = false;
+		return false;
+	}
+
+	const CameraPose& pose = this->m_Poses[this->m_Frame++];
+	camera.setPose(pose.position, pose.yaw, pose.pitch, pose.zoom);
+
+	return true;
+}
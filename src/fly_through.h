@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "glm/vec3.hpp"
+
+#include "camera.h"
+
+struct CameraPose
+{
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+	float zoom;
+};
+
+/*
+ * Records the camera pose every frame and plays it back, so the culling counters
+ * can be compared over the same path
+ */
+class FlyThrough
+{
+public:
+	FlyThrough();
+
+	void startRecording();
+	// Stops the recording and writes one pose per line to path
+	bool stopRecording(const std::string& path);
+
+	// Loads path and starts replaying it from the first pose
+	bool startPlayback(const std::string& path);
+
+	bool isRecording() const;
+	bool isPlaying() const;
+
+	void record(const Camera& camera);
+	// Moves the camera to the next pose, returns false once the path is over
+	bool play(Camera& camera);
+
+private:
+	std::vector<CameraPose> m_Poses;
+	size_t m_Frame;
+
+	bool m_Recording;
+	bool m_Playing;
+};
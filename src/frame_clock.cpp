@@ -0,0 +1,125 @@
+#include "frame_clock.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Steps simulated at most per frame, a longer hitch (loading, a dragged window) is dropped
+static const unsigned int MAX_STEPS = 8;
+
+// The end of a wait yields instead of sleeping, the scheduler may oversleep by about this much
+static const std::chrono::microseconds SLEEP_MARGIN(1500);
+
+FrameClock::FrameClock(float fixedStep, float frameRateCap)
+	: m_FixedStep(fixedStep)
+	, m_FrameRateCap(frameRateCap)
+	, m_Accumulator(0.0f)
+	, m_Start(std::chrono::steady_clock::now())
+	, m_LastFrame(m_Start)
+	, m_NextFrame(m_Start)
+	, m_Stats { 0, 0, 0.0f }
+{
+#ifdef _WIN32
+	// 1 ms scheduler granularity for the sleeps, 15.6 ms by default
+	timeBeginPeriod(1);
+#endif
+}
+
+FrameClock::~FrameClock()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+unsigned int FrameClock::beginFrame()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	float elapsed = std::chrono::duration<float>(now - this->m_LastFrame).count();
+	this->m_LastFrame = now;
+
+	this->m_Accumulator += std::min(elapsed, MAX_STEPS * this->m_FixedStep);
+
+	unsigned int steps = 0;
+	while (this->m_Accumulator >= this->m_FixedStep)
+	{
+		this->m_Accumulator -= this->m_FixedStep;
+		steps++;
+	}
+
+	this->m_Stats.frames++;
+	this->m_Stats.steps += steps;
+	return steps;
+}
+
+void FrameClock::waitForNextFrame()
+{
+	if (this->m_FrameRateCap <= 0.0f)
+	{
+		return;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	this->m_NextFrame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / this->m_FrameRateCap));
+
+	// A late frame restarts the schedule instead of rushing the next ones to catch up
+	if (this->m_NextFrame <= now)
+	{
+		this->m_NextFrame = now;
+		return;
+	}
+
+	if (this->m_NextFrame - now > SLEEP_MARGIN)
+	{
+		std::this_thread::sleep_for(this->m_NextFrame - now - SLEEP_MARGIN);
+	}
+	while (std::chrono::steady_clock::now() < this->m_NextFrame)
+	{
+		std::this_thread::yield();
+	}
+
+	this->m_Stats.sleepTime += std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - now).count();
+}
+
+float FrameClock::getFixedStep() const
+{
+	return this->m_FixedStep;
+}
+
+float FrameClock::getAlpha() const
+{
+	return this->m_Accumulator / this->m_FixedStep;
+}
+
+float FrameClock::getTime() const
+{
+	return std::chrono::duration<float>(std::chrono::steady_clock::now() - this->m_Start).count();
+}
+
+void FrameClock::setFrameRateCap(float frameRateCap)
+{
+	this->m_FrameRateCap = frameRateCap;
+	this->m_NextFrame = std::chrono::steady_clock::now();
+}
+
+float FrameClock::getFrameRateCap() const
+{
+	return this->m_FrameRateCap;
+}
+
+const FrameClockStats& FrameClock::getStats() const
+{
+	return this->m_Stats;
+}
+
+void FrameClock::resetStats()
+{
+	this->m_Stats.frames = 0;
+	this->m_Stats.steps = 0;
+	this->m_Stats.sleepTime = 0.0f;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+
+/*
+ * Counters accumulated since the last resetStats() call
+ */
+struct FrameClockStats
+{
+	unsigned int frames;
+	unsigned int steps;
+	float sleepTime; // microseconds
+};
+
+/*
+ * Fixed timestep clock. The time elapsed between frames is accumulated and consumed in
+ * steps of fixedStep seconds, so the simulation always advances by the same amount
+ * whatever the frame rate. getAlpha() tells how far the clock is past the last step,
+ * to interpolate the rendered state between the last two steps.
+ * With a frame rate cap, waitForNextFrame() sleeps away the rest of the frame period
+ * instead of rendering frames nobody sees
+ */
+class FrameClock
+{
+public:
+	// A cap of 0 leaves the pacing to vsync (or renders as fast as possible)
+	FrameClock(float fixedStep, float frameRateCap);
+	~FrameClock();
+
+	FrameClock(const FrameClock&) = delete;
+	FrameClock& operator=(const FrameClock&) = delete;
+
+	/*
+	 * Advances the clock, returns the number of fixed steps to simulate this frame
+	 */
+	unsigned int beginFrame();
+
+	/*
+	 * Blocks until the next frame is due, call right before presenting
+	 */
+	void waitForNextFrame();
+
+	float getFixedStep() const;
+	float getAlpha() const;
+
+	// Seconds since the clock was created
+	float getTime() const;
+
+	void setFrameRateCap(float frameRateCap);
+	float getFrameRateCap() const;
+
+	const FrameClockStats& getStats() const;
+	void resetStats();
+
+private:
+	float m_FixedStep;
+	float m_FrameRateCap;
+	float m_Accumulator;
+
+	std::chrono::steady_clock::time_point m_Start;
+	std::chrono::steady_clock::time_point m_LastFrame;
+	std::chrono::steady_clock::time_point m_NextFrame;
+
+	FrameClockStats m_Stats;
+};
@@ -1,32 +1,67 @@
 ﻿#include <iostream>
+#include <algorithm>
+#include <cstdlib>
 #include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <vector>
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 
 #include "glm/vec3.hpp"
+#include "glm/common.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/ext/matrix_transform.hpp"
 #include "glm/ext/matrix_clip_space.hpp"
-#include "glm/gtc/type_ptr.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
 #include "shaders/shader.h"
-#include "shaders/source.h"
+#include "shaders/shader_permutations.h"
+#include "shaders/shader_files.h"
+#include "shaders/program_cache.h"
+#include "renderer/frame_governor.h"
+#include "renderer/camera_uniforms.h"
+#include "renderer/ring_buffer.h"
+#include "renderer/gl_state.h"
+#include "renderer/render_graph.h"
+#include "renderer/frame_capture.h"
+#include "renderer/headless_context.h"
+#include "renderer/depth_pyramid.h"
+#include "terrain/patch_bounds.h"
+#include "terrain/patch_quadtree.h"
+#include "terrain/frustum_culler.h"
+#include "terrain/job_pool.h"
+#include "terrain/occlusion_culler.h"
+#include "terrain/horizon_culler.h"
+#include "terrain/visibility_cache.h"
+#include "terrain/patch_merger.h"
+#include "terrain/patch_draw_list.h"
+#include "terrain/patch_instancer.h"
+#include "terrain/gpu_culler.h"
+#include "terrain/height_tiles.h"
 #include "camera.h"
+#include "fly_through.h"
+#include "frame_clock.h"
 
+#ifdef _WIN32
 /*
  * Forces nvidia's driver to be used
  */
 extern "C" {
 	__declspec(dllexport) DWORD NvOptimusEnablement = 0x00000001;
 }
+#endif
 
+#ifndef HEADLESS
 void processInput(GLFWwindow* window);
+bool wasKeyPressed(GLFWwindow* window, int key, bool& keyDown);
 
 /*
  * Callbacks
@@ -35,6 +70,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+#endif
 
 /*
  * Screen size
@@ -54,11 +90,110 @@ Camera camera(
 	-150.0f,
 	-40.0f);
 
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+/*
+ * CPU culling toggle (C key), the TCS keeps discarding off-screen patches when disabled
+ */
+bool cpuCullingEnabled = true;
+bool cullingKeyDown = false;
+
+/*
+ * Reuse of the horizon and occlusion results across frames (T key)
+ */
+bool temporalCullingEnabled = true;
+bool temporalKeyDown = false;
+
+/*
+ * Distant patch merging into coarse quadtree node patches (M key), CPU path only
+ */
+bool patchMergingEnabled = true;
+bool mergingKeyDown = false;
+
+/*
+ * GPU driven culling and indirect draws (G key), only on GL 4.3+ contexts. Takes over
+ * from the CPU passes while enabled
+ */
+bool gpuCullingSupported = false;
+bool gpuCullingEnabled = false;
+bool gpuCullingKeyDown = false;
+
+/*
+ * Instanced unit patch instead of the indexed grid (I key), CPU path only: the GPU culler
+ * writes one indirect command per patch
+ */
+bool instancedDrawEnabled = false;
+bool instancedKeyDown = false;
+
+/*
+ * Fly-through recording (R key) and playback (P key), the culling counters are
+ * summed over the playback and reported at its end
+ */
+const char* FLY_THROUGH_PATH = "flythrough.txt";
+FlyThrough flyThrough;
+bool recordKeyDown = false;
+bool playKeyDown = false;
+
+/*
+ * Frame capture: F writes a PNG of the next frame, V toggles writing every frame as raw
+ * RGBA. The readbacks are fenced and written a few frames later by a worker thread
+ */
+bool screenshotRequested = false;
+bool continuousCaptureEnabled = false;
+bool screenshotKeyDown = false;
+bool continuousCaptureKeyDown = false;
+
+/*
+ * Frame time the FrameGovernor tries to hold (ms) and the range of LOD budgets it can pick from
+ */
+const float TARGET_FRAME_TIME = 1000.0f / 60.0f;
+const LodBudget LOWEST_LOD_BUDGET = { 2.0f, 8.0f, 10.0f, 300.0f };
+const LodBudget HIGHEST_LOD_BUDGET = { 4.0f, 32.0f, 20.0f, 600.0f };
+
+/*
+ * The camera moves in fixed steps of SIMULATION_STEP seconds whatever the frame rate, the
+ * frames render it interpolated between the last two steps. Without adaptive vsync the
+ * frames are paced to FRAME_RATE_CAP by sleeping (0 renders as fast as possible)
+ */
+const float SIMULATION_STEP = 1.0f / 120.0f;
+const float FRAME_RATE_CAP = 1000.0f / TARGET_FRAME_TIME;
+
+// The heightmap is split in HEIGHT_TILES * HEIGHT_TILES tiles, one texture array layer each
+const unsigned int HEIGHT_TILES = 4;
+
+/*
+ * Directory of the terrain stage files, relative to the working directory like the textures.
+ * The build copies them there, SHADERS_FROM_SOURCE_TREE points it at the source tree instead.
+ * A saved edit is rebuilt and swapped in while the application runs
+ */
+#ifndef SHADER_DIRECTORY
+#define SHADER_DIRECTORY "shaders"
+#endif
+
+/*
+ * Headless builds render this many frames (or until the recorded fly-through ends), then
+ * write the last one to HEADLESS_CAPTURE_PATH
+ */
+const unsigned int HEADLESS_FRAMES = 300;
+const char* HEADLESS_CAPTURE_PATH = "headless.png";
 
-int main()
+int main(int argc, char** argv)
 {
+#ifdef HEADLESS
+	// Desafio_ESSS_OpenGL [width height [frames]]
+	int headlessWidth = argc > 2 ? std::atoi(argv[1]) : SCREEN_WIDTH;
+	int headlessHeight = argc > 2 ? std::atoi(argv[2]) : SCREEN_HEIGHT;
+	unsigned int headlessFrames = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : HEADLESS_FRAMES;
+
+	// Loads GL itself, the frame goes to its framebuffer instead of a window
+	HeadlessContext headlessContext(std::max(headlessWidth, 1), std::max(headlessHeight, 1));
+	if (!headlessContext.isValid())
+	{
+		std::cout << "Failed to create the headless context" << std::endl;
+		return -1;
+	}
+
+	// Benchmarks run unpaced
+	float frameRateCap = 0.0f;
+#else
 	// Inicializa o GLFW
 	if (glfwInit() == GLFW_FALSE)
 	{
@@ -83,6 +218,18 @@ int main()
 	}
 	glfwMakeContextCurrent(window);
 
+	/*
+	 * Declared before every GL object of main, so the context goes away after them: their
+	 * destructors still call GL (FrameCapture waits for its last readbacks)
+	 */
+	struct GlfwTerminator
+	{
+		~GlfwTerminator()
+		{
+			glfwTerminate();
+		}
+	} glfwTerminator;
+
 	// Register callbacks
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetWindowSizeLimits(window, 800, 600, GLFW_DONT_CARE, GLFW_DONT_CARE);
@@ -98,23 +245,48 @@ int main()
 		return -1;
 	}
 
-	Shader shader(
-		ShaderSource::vertexShaderSource,
-		ShaderSource::fragmentShaderSource,
-		ShaderSource::tesselletionControlShaderSource,
-		ShaderSource::tesselletionEvaluationShaderSource);
+	/*
+	 * Adaptive vsync paces the frames when the driver has it, a late frame then tears
+	 * instead of waiting for the next refresh. Otherwise the FrameClock caps the rate
+	 */
+	bool adaptiveVsync = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+	glfwSwapInterval(adaptiveVsync ? -1 : 0);
+	float frameRateCap = adaptiveVsync ? 0.0f : FRAME_RATE_CAP;
+#endif
 
 	/*
-	 * Buffer for Heightmap Texture
+	 * With gl_DrawID (GL 4.6) every draw reads its chunk offset and LOD scale from the draw
+	 * records. The height tiles fall back to an atlas past the texture array layer limit
 	 */
-	unsigned int texture;
-	glGenTextures(1, &texture);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	ShaderFiles terrainFiles(SHADER_DIRECTORY, { "terrain.vert", "terrain.frag", "terrain.tesc", "terrain.tese" });
+	if (!terrainFiles.isLoaded())
+	{
+		std::cout << "Failed to load the terrain shaders from " << SHADER_DIRECTORY << std::endl;
+		return -1;
+	}
+
+	ShaderPermutations terrainPermutations(GLAD_GL_VERSION_4_6 ? "#version 460 core" : "#version 410 core", terrainFiles.getSources());
+
+	ShaderDefines terrainDefines;
+	terrainDefines.define("HEIGHT_SCALE", TERRAIN_HEIGHT_SCALE).define("HEIGHT_OFFSET", TERRAIN_HEIGHT_OFFSET);
+	if (GLAD_GL_VERSION_4_6)
+	{
+		terrainDefines.define("DRAW_DATA");
+	}
+	if (HeightTileSet::needsAtlas(HEIGHT_TILES * HEIGHT_TILES))
+	{
+		terrainDefines.define("HEIGHT_ATLAS");
+	}
+
+	Shader& shader = terrainPermutations.get(terrainDefines);
+
+	/*
+	 * Same stages placing every patch from its instance record, see PatchInstancer.
+	 * Built in the background the first time it is asked for, the indexed program draws until it is ready
+	 */
+	ShaderDefines instancedDefines = terrainDefines;
+	instancedDefines.define("INSTANCED");
+	Shader* instancedShader = nullptr;
 
 	int width = 0;
 	int height = 0;
@@ -122,50 +294,85 @@ int main()
 
 	unsigned int rez = 20;
 	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	PatchBounds patchBounds;
+	unsigned int heightBoundsTexture = 0;
+	std::unique_ptr<HeightTileSet> heightTiles;
+	glm::vec2 gridOrigin(0.0f);
+	glm::vec2 gridStep(1.0f);
+
+	// Patches are stored in quadtree order so every subtree is a contiguous range
+	PatchQuadtree patchQuadtree;
+	patchQuadtree.build(rez - 1, 4);
+
+	// Software occlusion culling, rasterized on every hardware thread
+	JobPool jobPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+	OcclusionCuller occlusionCuller(256, 192, jobPool);
 
 	stbi_set_flip_vertically_on_load(true);
 	unsigned char* data = stbi_load("textures/heightmap.png", &width, &height, &nrChannels, 0);
 	if (data)
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		shader.setUniformInt("heightMap", 0);
+		/*
+		 * Height tiles, every tile resident in its own layer
+		 */
+		heightTiles = std::make_unique<HeightTileSet>(width, height, HEIGHT_TILES, HEIGHT_TILES, HEIGHT_TILES * HEIGHT_TILES);
+		heightTiles->loadAll(data, nrChannels);
+		heightTiles->bind(0, 3);
 
 		/*
-		 * Vertex Generation
+		 * Vertex Generation, a rez * rez grid shared by the patches
 		 */
 		float heightInMin = -height / 2.0f;
 		float widthInMin = -width / 2.0f;
 
-		for (unsigned int i = 0; i < rez - 1; i++)
+		for (unsigned int i = 0; i < rez; i++)
 		{
-			for (unsigned int j = 0; j < rez - 1; j++)
+			for (unsigned int j = 0; j < rez; j++)
 			{
 				vertices.push_back(widthInMin + width * i / (float)rez);
 				vertices.push_back(0.0f);
 				vertices.push_back(heightInMin + height * j / (float)rez);
 				vertices.push_back(i / (float)rez);
 				vertices.push_back(j / (float)rez);
+			}
+		}
 
-				vertices.push_back(widthInMin + width * (i + 1) / (float)rez);
-				vertices.push_back(0.0f);
-				vertices.push_back(heightInMin + height * j / (float)rez);
-				vertices.push_back((i + 1) / (float)rez);
-				vertices.push_back(j / (float)rez);
-
-				vertices.push_back(widthInMin + width * i / (float)rez);
-				vertices.push_back(0.0f);
-				vertices.push_back(heightInMin + height * (j + 1) / (float)rez);
-				vertices.push_back(i / (float)rez);
-				vertices.push_back((j + 1) / (float)rez);
+		// Four corners per patch, in quadtree order
+		for (unsigned int patch : patchQuadtree.getPatchOrder())
+		{
+			unsigned int i = patch / (rez - 1);
+			unsigned int j = patch % (rez - 1);
 
-				vertices.push_back(widthInMin + width * (i + 1) / (float)rez);
-				vertices.push_back(0.0f);
-				vertices.push_back(heightInMin + height * (j + 1) / (float)rez);
-				vertices.push_back((i + 1) / (float)rez);
-				vertices.push_back((j + 1) / (float)rez);
-			}
+			indices.push_back(i * rez + j);
+			indices.push_back((i + 1) * rez + j);
+			indices.push_back(i * rez + j + 1);
+			indices.push_back((i + 1) * rez + j + 1);
 		}
+
+		// Followed by the coarse patch of every quadtree node
+		appendCoarsePatchIndices(patchQuadtree, rez, indices);
+
+		// The instanced patches rebuild the same vertices from the grid
+		gridOrigin = glm::vec2(widthInMin, heightInMin);
+		gridStep = glm::vec2(width / (float)rez, height / (float)rez);
+
+		patchBounds = computePatchBounds(data, width, height, nrChannels, rez, patchQuadtree.getPatchOrder(), LOWEST_LOD_BUDGET.minTessLevel);
+		patchQuadtree.updateBounds(patchBounds);
+		occlusionCuller.setOccluderMesh(computeOccluderMesh(data, width, height, nrChannels, rez, patchQuadtree.getPatchOrder(), 4, LOWEST_LOD_BUDGET.minTessLevel));
+
+		/*
+		 * Buffer for the patch height bounds, used by the TCS to discard off-screen patches
+		 */
+		std::vector<float> heightBoundsTexels = packHeightBounds(patchBounds, rez, patchQuadtree.getPatchOrder());
+
+		glGenTextures(1, &heightBoundsTexture);
+		GlState::get().bindTexture(1, GL_TEXTURE_2D, heightBoundsTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, rez, rez, 0, GL_RG, GL_FLOAT, heightBoundsTexels.data());
 	}
 	else
 	{
@@ -178,14 +385,14 @@ int main()
 	 */
 	unsigned int VAO;
 	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+	GlState::get().bindVertexArray(VAO);
 
 	/*
 	 * VBO
 	 */
 	unsigned int VBO;
 	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	GlState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
 
 	// Position
@@ -196,59 +403,614 @@ int main()
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(1);
 
+	/*
+	 * EBO
+	 */
+	unsigned int EBO;
+	glGenBuffers(1, &EBO);
+	GlState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
 	glPatchParameteri(GL_PATCH_VERTICES, 4);
 
-	shader.useProgram();
+	PatchInstancer patchInstancer(indices, rez);
 
 	/*
 	 * Model, View, Projection Matrix
 	 */
 	glm::mat4 modelMatrix = glm::mat4(1.0f);
-	int modelLocation = glGetUniformLocation(shader.getId(), "uModel");
-	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+
+	/*
+	 * Uniforms set once per terrain program, uniforms a program lacks are skipped
+	 */
+	auto setupTerrainProgram = [&](Shader& program)
+	{
+		program.useProgram();
+		if (heightTiles)
+		{
+			program.setUniformInt("heightTiles", 0);
+			program.setUniformInt("tileLayers", 3);
+			program.setUniformVec2(program.getUniform("uTileTexels"), heightTiles->getTileTexels());
+			program.setUniformInt("uAtlasColumns", heightTiles->getAtlasColumns());
+		}
+		program.setUniformInt("heightBounds", 1);
+		program.setUniformMat4(program.getUniform("uModel"), modelMatrix);
+		program.setUniformVec2(program.getUniform("uGridOrigin"), gridOrigin);
+		program.setUniformVec2(program.getUniform("uGridStep"), gridStep);
+		program.setUniformFloat("uGridResolution", static_cast<float>(rez));
+	};
+	setupTerrainProgram(shader);
+
+	// View and projection live in the Camera block shared by every program
+	CameraUniforms cameraUniforms;
+
+	/*
+	 * Per-frame dynamic data: the Camera block and the CPU path draw commands and records
+	 * (or instance records), at most one per visible patch or coarse node patch of the single
+	 * material. Three sections let the CPU write a frame while the GPU still reads the two before it
+	 */
+	std::size_t drawablePatches = patchBounds.size() + patchQuadtree.getNodeCount();
+	GLsizeiptr ringSectionSize = cameraUniforms.getFrameSize()
+		+ std::max(PatchDrawList::getRingSize(drawablePatches, 1), PatchInstancer::getRingSize(drawablePatches));
+	RingBuffer ringBuffer(ringSectionSize, 3);
+
+	/*
+	 * Uniforms written every frame, looked up once per terrain program
+	 */
+	struct LodUniforms
+	{
+		UniformHandle minTessLevel;
+		UniformHandle maxTessLevel;
+		UniformHandle minDistance;
+		UniformHandle maxDistance;
+	};
+
+	auto getLodUniforms = [](const Shader& program) -> LodUniforms
+	{
+		return { program.getUniform("uMinTessLevel"), program.getUniform("uMaxTessLevel"),
+			program.getUniform("uMinDistance"), program.getUniform("uMaxDistance") };
+	};
+
+	LodUniforms lodUniforms = getLodUniforms(shader);
+	LodUniforms instancedLodUniforms = {};
+	std::vector<std::string> changedTerrainSources;
 
 	/*
 	 * glEnable
 	 */
-	glEnable(GL_DEPTH_TEST);
+	GlState::get().setDepthTest(true);
+
+	FrameGovernor governor(TARGET_FRAME_TIME, LOWEST_LOD_BUDGET, HIGHEST_LOD_BUDGET);
+
+	// The cull compute shader shares camera.glsl with the terrain stages, a missing file leaves the CPU culling
+	std::unique_ptr<ShaderFiles> cullFiles;
+	std::unique_ptr<GpuCuller> gpuCuller;
+	std::unique_ptr<DepthPyramid> depthPyramid;
+	std::vector<std::string> changedCullSources;
+	if (GLAD_GL_VERSION_4_3)
+	{
+		cullFiles = std::make_unique<ShaderFiles>(SHADER_DIRECTORY, std::vector<std::string> { "patch_cull.comp" });
+	}
+	gpuCullingSupported = cullFiles != nullptr && cullFiles->isLoaded();
+	if (gpuCullingSupported)
+	{
+		gpuCuller = std::make_unique<GpuCuller>(patchBounds, 4, cullFiles->getSources()[0]);
+		depthPyramid = std::make_unique<DepthPyramid>();
+		gpuCullingEnabled = true;
+	}
+
+	// Programs built at startup, a warm start loads them from the binary cache. Variants built on first use come later
+	const ProgramCacheStats& programStats = ProgramCache::get().getStats();
+	std::cout << "[shaders] " << programStats.programs << " programs, " << programStats.hits << " from the binary cache";
+	if (programStats.rejected > 0)
+	{
+		std::cout << ", " << programStats.rejected << " stale";
+	}
+	std::cout << " (" << programStats.buildTime / 1000.0f << " ms)" << std::endl;
+
+	FrustumCuller frustumCuller;
+	HorizonCuller horizonCuller(2048);
+	VisibilityCache visibilityCache(30);
+	PatchMerger patchMerger(8.0f);
+	std::vector<unsigned int> visiblePatches;
+	std::vector<unsigned int> retestPatches;
+
+	unsigned long long flyThroughFrames = 0;
+	unsigned long long flyThroughVisible = 0;
+	unsigned long long flyThroughHorizonCulled = 0;
+	unsigned long long flyThroughOccluded = 0;
+	unsigned long long flyThroughReusedHidden = 0;
+	double flyThroughCullTime = 0.0;
+	PatchDrawList drawList;
+	RenderGraph renderGraph;
+	FrameCapture frameCapture(4);
+	unsigned int captureIndex = 0;
+
+	FrameClock frameClock(SIMULATION_STEP, frameRateCap);
+	glm::vec3 previousPosition = camera.position;
+	float lastStatsTime = 0.0f;
+
+#ifdef HEADLESS
+	GLuint defaultFramebuffer = headlessContext.getFramebuffer();
+	bool headlessPlayback = flyThrough.startPlayback(FLY_THROUGH_PATH);
+	unsigned int headlessFrame = 0;
+	float headlessStart = frameClock.getTime();
+
+	while (headlessFrame < headlessFrames && (!headlessPlayback || flyThrough.isPlaying()))
+#else
+	GLuint defaultFramebuffer = 0;
 
 	while (!glfwWindowShouldClose(window))
+#endif
 	{
+#ifndef HEADLESS
+		// Nothing is drawn while minimized, the thread sleeps until the next event
+		if (glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+		{
+			glfwWaitEvents();
+			continue;
+		}
+#endif
+
+		unsigned int steps = frameClock.beginFrame();
+		float currentFrame = frameClock.getTime();
+
+#ifndef HEADLESS
+		processInput(window);
+#endif
+
+		for (unsigned int step = 0; step < steps; step++)
+		{
+			previousPosition = camera.position;
+#ifndef HEADLESS
+			camera.processMovement(window, frameClock.getFixedStep());
+#endif
+		}
+
+		if (flyThrough.isPlaying())
+		{
+			if (!flyThrough.play(camera))
+			{
+				// Against the frustum visible patches, with T the re-tested ones are only part of them
+				std::cout << "[flythrough] " << flyThroughFrames << " frames, horizon culled "
+					<< 100.0 * flyThroughHorizonCulled / std::max(flyThroughVisible, 1ull) << "%, occlusion culled "
+					<< 100.0 * flyThroughOccluded / std::max(flyThroughVisible, 1ull) << "%, reused as hidden "
+					<< 100.0 * flyThroughReusedHidden / std::max(flyThroughVisible, 1ull) << "% of the frustum visible patches, culling took "
+					<< flyThroughCullTime / std::max(flyThroughFrames, 1ull) << " us per frame" << std::endl;
+
+				flyThroughFrames = 0;
+				flyThroughVisible = 0;
+				flyThroughHorizonCulled = 0;
+				flyThroughOccluded = 0;
+				flyThroughReusedHidden = 0;
+				flyThroughCullTime = 0.0;
+			}
+		}
+		flyThrough.record(camera);
+
+		// Played back poses are shown as they are
+		if (flyThrough.isPlaying())
+		{
+			previousPosition = camera.position;
+		}
+		glm::vec3 eyePosition = glm::mix(previousPosition, camera.position, frameClock.getAlpha());
+
+		governor.beginFrame();
+
+		// Saved stage files, the programs in use keep drawing until the new ones link
+		if (terrainFiles.takeChanged(changedTerrainSources))
+		{
+			terrainPermutations.reload(std::move(changedTerrainSources));
+		}
+		if (terrainPermutations.update())
+		{
+			setupTerrainProgram(shader);
+			lodUniforms = getLodUniforms(shader);
+			if (instancedShader != nullptr)
+			{
+				setupTerrainProgram(*instancedShader);
+				instancedLodUniforms = getLodUniforms(*instancedShader);
+			}
+			std::cout << "[shaders] terrain reloaded, " << terrainPermutations.getVariantCount() << " variants" << std::endl;
+		}
+		if (gpuCullingSupported && cullFiles->takeChanged(changedCullSources))
+		{
+			gpuCuller->reload(std::move(changedCullSources[0]));
+		}
+
+		// Without KHR_parallel_shader_compile the first poll waits for the build
+		if (instancedDrawEnabled && instancedShader == nullptr)
+		{
+			Shader& candidate = terrainPermutations.get(instancedDefines, ShaderBuild::Async);
+			if (candidate.isReady())
+			{
+				setupTerrainProgram(candidate);
+				instancedLodUniforms = getLodUniforms(candidate);
+				instancedShader = &candidate;
+			}
+		}
+
+		// The fly-through report measures the CPU passes, a playback runs them even with G on
+		bool gpuCulling = gpuCullingEnabled && !flyThrough.isPlaying();
+
+		bool drawInstanced = instancedDrawEnabled && !gpuCulling && instancedShader != nullptr;
+		Shader& terrainShader = drawInstanced ? *instancedShader : shader;
+		const LodUniforms& terrainUniforms = drawInstanced ? instancedLodUniforms : lodUniforms;
+
+		// The compute passes of the last frame left their own program bound
+		terrainShader.useProgram();
+		GlState::get().bindVertexArray(VAO);
+		GlState::get().polygonMode(camera.isWireframe() ? GL_LINE : GL_FILL);
+
+		const LodBudget& budget = governor.getBudget();
+		terrainShader.setUniformFloat(terrainUniforms.minTessLevel, budget.minTessLevel);
+		terrainShader.setUniformFloat(terrainUniforms.maxTessLevel, budget.maxTessLevel);
+		terrainShader.setUniformFloat(terrainUniforms.minDistance, budget.minDistance);
+		terrainShader.setUniformFloat(terrainUniforms.maxDistance, budget.maxDistance);
+
+		int framebufferWidth = 0;
+		int framebufferHeight = 0;
+#ifdef HEADLESS
+		framebufferWidth = headlessContext.getWidth();
+		framebufferHeight = headlessContext.getHeight();
+#else
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+#endif
+
+		// A minimized window has no framebuffer, the projection keeps the initial aspect
+		float aspect = framebufferHeight > 0 ? static_cast<float>(framebufferWidth) / framebufferHeight : static_cast<float>(SCREEN_WIDTH) / SCREEN_HEIGHT;
+		glm::mat4 projectionMatrix = glm::perspective(glm::radians(camera.m_Zoom), aspect, 0.1f, 100000.0f);
+		glm::mat4 viewMatrix = camera.getViewMatrix(eyePosition);
+		ringBuffer.beginFrame();
+		cameraUniforms.update(ringBuffer, viewMatrix, projectionMatrix, eyePosition);
+
 		/*
-		 * Calculate the time each frame took to render
-		 * This value is used to keep a smooth camera moviment
+		 * Only the patches inside the view frustum are submitted
 		 */
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		glm::mat4 viewProjection = projectionMatrix * viewMatrix * modelMatrix;
+		Frustum frustum(viewProjection);
 
-		processInput(window);
+		/*
+		 * Frame passes, culling feeds the terrain draw through the visible patches handle.
+		 * The terrain is drawn into textures of the graph, the depth pyramid samples the
+		 * depth without a copy and the color is blitted to the backbuffer
+		 */
+		renderGraph.reset();
+		RenderGraph::Resource backbuffer = renderGraph.importFramebuffer("backbuffer", defaultFramebuffer, framebufferWidth, framebufferHeight);
+		RenderGraph::Resource visibleSet = renderGraph.createHandle("visible patches");
+		RenderGraph::Resource sceneColor = renderGraph.createTexture("scene color", { framebufferWidth, framebufferHeight, GL_RGBA8 });
+		RenderGraph::Resource sceneDepth = renderGraph.createTexture("scene depth", { framebufferWidth, framebufferHeight, GL_DEPTH_COMPONENT24 });
+
+		auto clearScene = []()
+		{
+			glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		};
+
+		if (gpuCulling)
+		{
+			RenderGraph::Resource pyramid = renderGraph.importTexture("depth pyramid", depthPyramid->getTexture());
+
+			renderGraph.addPass("gpu cull",
+				[&](RenderGraph::PassBuilder& pass) { pass.read(pyramid); pass.write(visibleSet); },
+				[&]() { gpuCuller->cull(frustum, *depthPyramid); });
+
+			renderGraph.addPass("terrain",
+				[&](RenderGraph::PassBuilder& pass) { pass.read(visibleSet); pass.write(sceneColor); pass.write(sceneDepth); },
+				[&]()
+				{
+					clearScene();
+					shader.useProgram();
+					gpuCuller->draw();
+				});
+
+			// This frame's depth feeds the occlusion test of the next one
+			renderGraph.addPass("depth pyramid",
+				[&](RenderGraph::PassBuilder& pass) { pass.read(sceneDepth); pass.write(pyramid); },
+				[&]()
+				{
+					depthPyramid->update(renderGraph.getTexture(sceneDepth), framebufferWidth, framebufferHeight, viewProjection);
+					visibilityCache.invalidate();
+				});
+		}
+		else
+		{
+			// The pyramid misses the frames drawn without it
+			if (depthPyramid)
+			{
+				depthPyramid->invalidate();
+			}
+
+			renderGraph.addPass("cpu cull",
+				[&](RenderGraph::PassBuilder& pass) { pass.write(visibleSet); },
+				[&]()
+				{
+					if (cpuCullingEnabled)
+					{
+						// Cheapest first: frustum and normal cones, horizon, then the software occlusion
+						frustumCuller.cull(patchQuadtree, patchBounds, frustum, eyePosition, visiblePatches);
+						float cullTime = frustumCuller.getStats().time;
+
+						if (temporalCullingEnabled)
+						{
+							// The occluders still come from every frustum visible patch, only the stale chunks are tested
+							unsigned int occluderVersion = occlusionCuller.selectOccluders(patchBounds, eyePosition, visiblePatches);
+							visibilityCache.split(patchQuadtree, frustum, eyePosition, occluderVersion, visiblePatches, retestPatches);
+							horizonCuller.cull(patchQuadtree, patchBounds, eyePosition, retestPatches);
+							occlusionCuller.cullSelected(patchBounds, viewProjection, retestPatches);
+							visibilityCache.merge(retestPatches, visiblePatches);
+							cullTime += visibilityCache.getStats().time;
+						}
+						else
+						{
+							visibilityCache.invalidate();
+							horizonCuller.cull(patchQuadtree, patchBounds, eyePosition, visiblePatches);
+							occlusionCuller.cull(patchBounds, viewProjection, eyePosition, visiblePatches);
+						}
+						cullTime += horizonCuller.getStats().time + occlusionCuller.getStats().time;
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+						if (flyThrough.isPlaying())
+						{
+							flyThroughFrames++;
+							flyThroughVisible += frustumCuller.getStats().visible;
+							flyThroughHorizonCulled += horizonCuller.getStats().culled;
+							flyThroughOccluded += occlusionCuller.getStats().occluded;
+							flyThroughReusedHidden += temporalCullingEnabled ? visibilityCache.getStats().reusedHidden : 0;
+							flyThroughCullTime += cullTime;
+						}
+					}
+					else
+					{
+						visibilityCache.invalidate();
+						visiblePatches.resize(patchBounds.size());
+						std::iota(visiblePatches.begin(), visiblePatches.end(), 0);
+					}
 
-		glm::mat4 projectionMatrix = glm::perspective(glm::radians(camera.m_Zoom), (float)SCREEN_WIDTH / float(SCREEN_HEIGHT), 0.1f, 100000.0f);
-		int projectionLocation = glGetUniformLocation(shader.getId(), "uProjection");
-		glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+					if (patchMergingEnabled)
+					{
+						patchMerger.merge(patchQuadtree, eyePosition, projectionMatrix, static_cast<float>(framebufferHeight), visiblePatches);
+					}
+				});
 
-		glm::mat4 viewMatrix = camera.getViewMatrix();
-		int viewLocaltion = glGetUniformLocation(shader.getId(), "uView");
-		glUniformMatrix4fv(viewLocaltion, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+			renderGraph.addPass("terrain",
+				[&](RenderGraph::PassBuilder& pass) { pass.read(visibleSet); pass.write(sceneColor); pass.write(sceneDepth); },
+				[&]()
+				{
+					clearScene();
+					if (drawInstanced)
+					{
+						patchInstancer.draw(ringBuffer, visiblePatches);
+					}
+					else
+					{
+						drawList.build(visiblePatches, 4);
+						drawList.draw(ringBuffer);
+					}
+				});
+		}
+
+		renderGraph.addPass("present",
+			[&](RenderGraph::PassBuilder& pass) { pass.read(sceneColor); pass.write(backbuffer); },
+			[&]()
+			{
+				// The graph bound the backbuffer for both, only the read side changes for the blit
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, renderGraph.getWriterFramebuffer(sceneColor));
+				glBlitFramebuffer(0, 0, framebufferWidth, framebufferHeight, 0, 0, framebufferWidth, framebufferHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, defaultFramebuffer);
+			});
+
+		// Only queues the readback, nothing here waits on the GPU
+		if (screenshotRequested || continuousCaptureEnabled)
+		{
+			renderGraph.addPass("capture",
+				[&](RenderGraph::PassBuilder& pass) { pass.read(backbuffer); pass.markSideEffect(); },
+				[&]()
+				{
+					CaptureFormat format = screenshotRequested ? CaptureFormat::Png : CaptureFormat::Raw;
+					std::string path = "capture_" + std::to_string(captureIndex++) + (screenshotRequested ? ".png" : ".rgba");
+
+					GlState::get().bindFramebuffer(defaultFramebuffer);
+					frameCapture.capture(framebufferWidth, framebufferHeight, path, format);
+					screenshotRequested = false;
+				});
+		}
+
+		renderGraph.compile();
+		renderGraph.execute();
+		frameCapture.update();
+
+		ringBuffer.endFrame();
+		GlState::get().endFrame();
+		governor.endFrame();
+
+		// Prints the frame counters once per second
+		if (currentFrame - lastStatsTime >= 1.0f)
+		{
+			lastStatsTime = currentFrame;
+
+			if (gpuCulling)
+			{
+				std::cout << "[gpu cull] visible " << gpuCuller->readVisibleCount() << "/" << gpuCuller->getPatchCount()
+					<< " patches" << std::endl;
+			}
+			else
+			{
+				const CullStats& cullStats = frustumCuller.getStats();
+				std::cout << "[cull] visible " << cullStats.visible << "/" << patchBounds.size()
+					<< " patches, " << cullStats.backfacing << " back facing, " << cullStats.nodesVisited << " nodes, "
+					<< cullStats.tested << " patch tests, "
+					<< patchBounds.size() / std::max(cullStats.time, 0.001f) << " patches/us" << std::endl;
 
-		glDrawArrays(GL_PATCHES, 0, 4 * rez * rez);
+				// With T only the patches of the stale chunks go through these passes
+				const char* tested = temporalCullingEnabled && cpuCullingEnabled ? " re-tested" : "";
 
+				const HorizonStats& horizonStats = horizonCuller.getStats();
+				std::cout << "[horizon] " << horizonStats.culled << "/" << horizonStats.tested << tested << " patches below the horizon ("
+					<< 100.0f * horizonStats.culled / std::max(horizonStats.tested, 1u) << "%) in " << horizonStats.time << " us" << std::endl;
+
+				const OcclusionStats& occlusionStats = occlusionCuller.getStats();
+				std::cout << "[occlusion] " << occlusionStats.occluded << "/" << occlusionStats.tested << tested << " patches occluded ("
+					<< 100.0f * occlusionStats.occluded / std::max(occlusionStats.tested, 1u) << "%) by "
+					<< occlusionStats.occluders << " occluders in " << occlusionStats.time << " us" << std::endl;
+
+				if (temporalCullingEnabled && cpuCullingEnabled)
+				{
+					const VisibilityCacheStats& cacheStats = visibilityCache.getStats();
+					std::cout << "[temporal] " << cacheStats.retested << "/" << cacheStats.chunks << " chunks re-tested"
+						<< (cacheStats.revalidated ? " (full re-validation), " : ", ") << cacheStats.reusedPatches
+						<< " patches reused (" << cacheStats.reusedHidden << " hidden) in " << cacheStats.time << " us" << std::endl;
+				}
+
+				if (patchMergingEnabled)
+				{
+					const MergeStats& mergeStats = patchMerger.getStats();
+					std::cout << "[merge] " << mergeStats.merged << " distant patches drawn as " << mergeStats.coarsePatches
+						<< " coarse patches in " << mergeStats.time << " us" << std::endl;
+				}
+
+				if (drawInstanced)
+				{
+					std::cout << "[instanced] " << visiblePatches.size() << " patches from one 4 vertex patch, "
+						<< visiblePatches.size() * PatchInstancer::getInstanceSize() << " bytes of instance records instead of "
+						<< visiblePatches.size() * 4 * sizeof(GLuint) << " bytes of indices" << std::endl;
+				}
+			}
+
+			// Fence waits mean the GPU still reads a section when it comes back, the ring is too small
+			const RingBufferStats& ringStats = ringBuffer.getStats();
+			std::cout << "[ring] " << (ringBuffer.isPersistent() ? "persistent" : "staged") << ", peak "
+				<< ringStats.peakUsage << "/" << ringSectionSize << " bytes per frame, " << ringStats.fenceWaits << " fence waits over "
+				<< ringStats.frames << " frames (" << ringStats.waitTime << " us), " << ringStats.overflows << " overflows" << std::endl;
+			ringBuffer.resetStats();
+
+			const GlStateStats& stateStats = GlState::get().getStats();
+			std::cout << "[state] " << stateStats.issued / std::max(stateStats.frames, 1u) << " calls issued, "
+				<< stateStats.skipped / std::max(stateStats.frames, 1u) << " redundant skipped per frame" << std::endl;
+			GlState::get().resetStats();
+
+			std::cout << "[passes]";
+			for (const RenderGraphPassTime& passTime : renderGraph.getPassTimes())
+			{
+				std::cout << " " << passTime.name << " " << passTime.time / std::max(passTime.runs, 1u) << " us";
+			}
+			std::cout << " (CPU, per frame)" << std::endl;
+			renderGraph.resetStats();
+
+			const FrameClockStats& clockStats = frameClock.getStats();
+			std::cout << "[pacing] " << clockStats.frames << " fps";
+			if (frameClock.getFrameRateCap() > 0.0f)
+			{
+				std::cout << " (cap " << frameClock.getFrameRateCap() << ")";
+			}
+			std::cout << ", " << clockStats.steps << " simulation steps, "
+				<< clockStats.sleepTime / std::max(clockStats.frames, 1u) / 1000.0f << " ms slept per frame" << std::endl;
+			frameClock.resetStats();
+
+			FrameCaptureStats captureStats = frameCapture.getStats();
+			if (captureStats.requested > 0)
+			{
+				std::cout << "[capture] " << captureStats.written << " written, " << captureStats.dropped << "/"
+					<< captureStats.requested << " dropped (every readback busy), "
+					<< captureStats.issueTime / captureStats.requested << " us per capture on the render thread" << std::endl;
+				frameCapture.resetStats();
+			}
+		}
+
+		frameClock.waitForNextFrame();
+
+#ifdef HEADLESS
+		headlessFrame++;
+#else
 		glfwSwapBuffers(window);
 
 		glfwPollEvents();
+#endif
 	}
 
-	glfwTerminate();
+#ifdef HEADLESS
+	float headlessTime = frameClock.getTime() - headlessStart;
+	std::cout << "[headless] " << headlessFrame << " frames at " << headlessContext.getWidth() << "x" << headlessContext.getHeight()
+		<< " in " << headlessTime << " s, " << 1000.0f * headlessTime / std::max(headlessFrame, 1u) << " ms per frame" << std::endl;
+
+	// The framebuffer still holds the last frame, written before the capture worker stops
+	GlState::get().bindFramebuffer(defaultFramebuffer);
+	frameCapture.capture(headlessContext.getWidth(), headlessContext.getHeight(), HEADLESS_CAPTURE_PATH, CaptureFormat::Png);
+#endif
 	return 0;
 }
 
+#ifndef HEADLESS
+
 void processInput(GLFWwindow* window)
 {
 	camera.processKeyboard(window);
+
+	if (wasKeyPressed(window, GLFW_KEY_C, cullingKeyDown))
+	{
+		cpuCullingEnabled = !cpuCullingEnabled;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_T, temporalKeyDown))
+	{
+		temporalCullingEnabled = !temporalCullingEnabled;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_M, mergingKeyDown))
+	{
+		patchMergingEnabled = !patchMergingEnabled;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_G, gpuCullingKeyDown) && gpuCullingSupported)
+	{
+		gpuCullingEnabled = !gpuCullingEnabled;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_I, instancedKeyDown))
+	{
+		instancedDrawEnabled = !instancedDrawEnabled;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_R, recordKeyDown))
+	{
+		if (flyThrough.isRecording())
+		{
+			flyThrough.stopRecording(FLY_THROUGH_PATH);
+		}
+		else
+		{
+			flyThrough.startRecording();
+		}
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_F, screenshotKeyDown))
+	{
+		screenshotRequested = true;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_V, continuousCaptureKeyDown))
+	{
+		continuousCaptureEnabled = !continuousCaptureEnabled;
+	}
+
+	if (wasKeyPressed(window, GLFW_KEY_P, playKeyDown) && !flyThrough.isRecording())
+	{
+		if (!flyThrough.startPlayback(FLY_THROUGH_PATH))
+		{
+			std::cout << "Failed to load " << FLY_THROUGH_PATH << std::endl;
+		}
+	}
+}
+
+/*
+ * True only on the frame the key goes down
+ */
+bool wasKeyPressed(GLFWwindow* window, int key, bool& keyDown)
+{
+	bool down = glfwGetKey(window, key) == GLFW_PRESS;
+	bool pressed = down && !keyDown;
+	keyDown = down;
+
+	return pressed;
 }
 
 /*
@@ -256,7 +1018,7 @@ void processInput(GLFWwindow* window)
  */
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	GlState::get().viewport(0, 0, width, height);
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
@@ -273,3 +1035,5 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	camera.scrollCallback(window, xoffset, yoffset);
 }
+
+#endif // HEADLESS
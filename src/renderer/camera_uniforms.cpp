@@ -0,0 +1,34 @@
+#include "camera_uniforms.h"
+
+#include <algorithm>
+
+#include "gl_state.h"
+
+CameraUniforms::CameraUniforms()
+	: m_Alignment(0)
+{
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	this->m_Alignment = std::max<GLsizeiptr>(alignment, 1);
+}
+
+void CameraUniforms::update(RingBuffer& ring, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& eye)
+{
+	GLintptr offset = 0;
+	void* destination = ring.allocate(sizeof(Block), this->m_Alignment, offset);
+	if (destination == nullptr)
+	{
+		return;
+	}
+
+	Block* block = static_cast<Block*>(destination);
+	*block = { view, projection, projection * view, glm::vec4(eye, 1.0f) };
+	ring.commit();
+
+	GlState::get().bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ring.getBuffer(), offset, sizeof(Block));
+}
+
+GLsizeiptr CameraUniforms::getFrameSize() const
+{
+	return (sizeof(Block) + this->m_Alignment - 1) / this->m_Alignment * this->m_Alignment + this->m_Alignment;
+}
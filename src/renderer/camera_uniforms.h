@@ -0,0 +1,43 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+
+#include "../shaders/shader.h"
+#include "ring_buffer.h"
+
+/*
+ * Data of the std140 "Camera" uniform block. Every program declaring the block reads
+ * it from CAMERA_BLOCK_BINDING, so the matrices are written once per frame instead of
+ * once per program. Each frame gets its own copy in the ring buffer
+ */
+class CameraUniforms
+{
+public:
+	CameraUniforms();
+
+	/*
+	 * Writes the block to the current ring section and binds it. On a full section the
+	 * previous binding is kept
+	 */
+	void update(RingBuffer& ring, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& eye);
+
+	/*
+	 * Bytes update() takes from a ring section, alignment included
+	 */
+	GLsizeiptr getFrameSize() const;
+
+private:
+	// Matches the Camera block, std140 lays mat4 and vec4 members out without padding
+	struct Block
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		glm::vec4 eye;
+	};
+
+	GLsizeiptr m_Alignment;
+};
@@ -0,0 +1,107 @@
+#include "depth_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "gl_state.h"
+#include "../shaders/source.h"
+
+// Texture unit used while reading the depth texture, GpuCuller samples the pyramid on the same one
+static const GLenum WORK_TEXTURE_UNIT = GL_TEXTURE2;
+static const GLuint GROUP_SIZE = 8;
+
+DepthPyramid::DepthPyramid()
+	: m_CopyShader(ShaderSource::depthCopyComputeShaderSource)
+	, m_ReduceShader(ShaderSource::depthReduceComputeShaderSource)
+	, m_DepthUniform(m_CopyShader.getUniform("depth"))
+	, m_PyramidTexture(0)
+	, m_Width(0)
+	, m_Height(0)
+	, m_Levels(0)
+	, m_Valid(false)
+	, m_ViewProjection(1.0f)
+{
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	GlState::get().deleteTexture(this->m_PyramidTexture);
+}
+
+void DepthPyramid::update(GLuint depthTexture, int width, int height, const glm::mat4& viewProjection)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	if (width != this->m_Width || height != this->m_Height)
+	{
+		this->allocate(width, height);
+	}
+
+	GlState::get().bindTexture(WORK_TEXTURE_UNIT - GL_TEXTURE0, GL_TEXTURE_2D, depthTexture);
+
+	// Level 0 is a plain copy, image load/store cannot access depth formats
+	this->m_CopyShader.useProgram();
+	this->m_CopyShader.setUniformInt(this->m_DepthUniform, WORK_TEXTURE_UNIT - GL_TEXTURE0);
+	glBindImageTexture(0, this->m_PyramidTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glDispatchCompute((width + GROUP_SIZE - 1) / GROUP_SIZE, (height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+	this->m_ReduceShader.useProgram();
+	int levelWidth = width;
+	int levelHeight = height;
+	for (int level = 1; level < this->m_Levels; level++)
+	{
+		levelWidth = std::max(levelWidth / 2, 1);
+		levelHeight = std::max(levelHeight / 2, 1);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glBindImageTexture(0, this->m_PyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, this->m_PyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((levelWidth + GROUP_SIZE - 1) / GROUP_SIZE, (levelHeight + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	this->m_ViewProjection = viewProjection;
+	this->m_Valid = true;
+}
+
+void DepthPyramid::invalidate()
+{
+	this->m_Valid = false;
+}
+
+GLuint DepthPyramid::getTexture() const
+{
+	return this->m_PyramidTexture;
+}
+
+bool DepthPyramid::isValid() const
+{
+	return this->m_Valid;
+}
+
+const glm::mat4& DepthPyramid::getViewProjection() const
+{
+	return this->m_ViewProjection;
+}
+
+void DepthPyramid::allocate(int width, int height)
+{
+	GlState::get().deleteTexture(this->m_PyramidTexture);
+
+	this->m_Width = width;
+	this->m_Height = height;
+	this->m_Levels = static_cast<int>(std::floor(std::log2(std::max(width, height)))) + 1;
+	this->m_Valid = false;
+
+	glGenTextures(1, &this->m_PyramidTexture);
+	GlState::get().bindTexture(WORK_TEXTURE_UNIT - GL_TEXTURE0, GL_TEXTURE_2D, this->m_PyramidTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexStorage2D(GL_TEXTURE_2D, this->m_Levels, GL_R32F, width, height);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "glad/glad.h"
+#include "glm/mat4x4.hpp"
+
+#include "../shaders/shader.h"
+
+/*
+ * Max depth pyramid (Hi-Z) of the last rendered frame. The depth texture of the frame is
+ * reduced with compute shaders, every texel holding the farthest depth it covers.
+ * Needs GL 4.3
+ */
+class DepthPyramid
+{
+public:
+	DepthPyramid();
+	~DepthPyramid();
+
+	DepthPyramid(const DepthPyramid&) = delete;
+	DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+	/*
+	 * Rebuilds every level from a depth texture of width * height, sampled in place.
+	 * viewProjection is the matrix the frame was rendered with
+	 */
+	void update(GLuint depthTexture, int width, int height, const glm::mat4& viewProjection);
+
+	/*
+	 * Marks the content as stale, e.g. after frames rendered without it
+	 */
+	void invalidate();
+
+	GLuint getTexture() const;
+	bool isValid() const;
+	const glm::mat4& getViewProjection() const;
+
+private:
+	Shader m_CopyShader;
+	Shader m_ReduceShader;
+	UniformHandle m_DepthUniform;
+
+	GLuint m_PyramidTexture;
+	int m_Width;
+	int m_Height;
+	int m_Levels;
+
+	bool m_Valid;
+	glm::mat4 m_ViewProjection;
+
+	void allocate(int width, int height);
+};
@@ -0,0 +1,359 @@
+#include "frame_capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include "gl_state.h"
+
+// Largest stored deflate block
+static const std::size_t DEFLATE_BLOCK_SIZE = 65535;
+
+static std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, std::size_t size)
+{
+	static std::uint32_t table[256] = {};
+	if (table[1] == 0)
+	{
+		for (std::uint32_t i = 0; i < 256; i++)
+		{
+			std::uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	for (std::size_t i = 0; i < size; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void appendU32(std::vector<unsigned char>& out, std::uint32_t value)
+{
+	out.push_back(static_cast<unsigned char>(value >> 24));
+	out.push_back(static_cast<unsigned char>(value >> 16));
+	out.push_back(static_cast<unsigned char>(value >> 8));
+	out.push_back(static_cast<unsigned char>(value));
+}
+
+static void appendChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+{
+	appendU32(out, static_cast<std::uint32_t>(data.size()));
+	std::size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	appendU32(out, crc32(0, &out[start], out.size() - start));
+}
+
+/*
+ * Rows of pixels are bottom-up as read by GL, the files store the top row first.
+ * The PNG keeps the image data in stored (uncompressed) deflate blocks: bigger files,
+ * but the worker keeps up with continuous captures without a compression library
+ */
+static bool writePng(const std::string& path, const unsigned char* pixels, int width, int height)
+{
+	std::size_t rowSize = static_cast<std::size_t>(width) * 4;
+
+	std::vector<unsigned char> scanlines;
+	scanlines.reserve((rowSize + 1) * height);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		scanlines.push_back(0); // filter: none
+		const unsigned char* row = pixels + rowSize * y;
+		scanlines.insert(scanlines.end(), row, row + rowSize);
+	}
+
+	std::vector<unsigned char> zlib = { 0x78, 0x01 };
+	zlib.reserve(scanlines.size() + scanlines.size() / DEFLATE_BLOCK_SIZE * 5 + 16);
+	std::size_t offset = 0;
+	do
+	{
+		std::size_t size = std::min(DEFLATE_BLOCK_SIZE, scanlines.size() - offset);
+		bool last = offset + size == scanlines.size();
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(static_cast<unsigned char>(size));
+		zlib.push_back(static_cast<unsigned char>(size >> 8));
+		zlib.push_back(static_cast<unsigned char>(~size));
+		zlib.push_back(static_cast<unsigned char>(~size >> 8));
+		zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+		offset += size;
+	} while (offset < scanlines.size());
+
+	std::uint32_t a = 1;
+	std::uint32_t b = 0;
+	for (unsigned char byte : scanlines)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendU32(zlib, (b << 16) | a);
+
+	std::vector<unsigned char> header;
+	appendU32(header, static_cast<std::uint32_t>(width));
+	appendU32(header, static_cast<std::uint32_t>(height));
+	header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bits, RGBA
+
+	std::vector<unsigned char> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	appendChunk(file, "IHDR", header);
+	appendChunk(file, "IDAT", zlib);
+	appendChunk(file, "IEND", {});
+
+	std::ofstream stream(path, std::ios::binary);
+	stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return stream.good();
+}
+
+static bool writeRaw(const std::string& path, const unsigned char* pixels, int width, int height)
+{
+	std::size_t rowSize = static_cast<std::size_t>(width) * 4;
+
+	std::ofstream stream(path, std::ios::binary);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		stream.write(reinterpret_cast<const char*>(pixels + rowSize * y), rowSize);
+	}
+	return stream.good();
+}
+
+FrameCapture::FrameCapture(unsigned int slotCount)
+	: m_Persistent(GLAD_GL_VERSION_4_4)
+	, m_Stop(false)
+	, m_Stats { 0, 0, 0, 0.0f }
+{
+	this->m_Slots.resize(std::max(slotCount, 1u));
+	for (Slot& slot : this->m_Slots)
+	{
+		glGenBuffers(1, &slot.buffer);
+		slot.size = 0;
+		slot.mapped = nullptr;
+		slot.fence = nullptr;
+		slot.width = 0;
+		slot.height = 0;
+		slot.format = CaptureFormat::Png;
+		slot.state = SlotState::Free;
+	}
+
+	this->m_Worker = std::thread(&FrameCapture::workerLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	// Blocks on the readbacks still in flight so every requested file is written
+	for (Slot& slot : this->m_Slots)
+	{
+		if (slot.fence != nullptr)
+		{
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+	}
+	this->update();
+
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		this->m_Stop = true;
+	}
+	this->m_WorkReady.notify_all();
+	this->m_Worker.join();
+
+	for (Slot& slot : this->m_Slots)
+	{
+		if (slot.mapped != nullptr)
+		{
+			GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool FrameCapture::capture(int width, int height, const std::string& path, CaptureFormat format)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	this->m_Stats.requested++;
+
+	Slot* free = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		for (Slot& slot : this->m_Slots)
+		{
+			if (slot.state == SlotState::Free)
+			{
+				free = &slot;
+				slot.state = SlotState::Reading;
+				break;
+			}
+		}
+	}
+
+	if (free == nullptr || width <= 0 || height <= 0)
+	{
+		if (free != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(this->m_Mutex);
+			free->state = SlotState::Free;
+		}
+		this->m_Stats.dropped++;
+		return false;
+	}
+
+	GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, free->buffer);
+
+	GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * 4;
+	if (free->size < size)
+	{
+		this->allocate(*free, size);
+	}
+
+	// Returns at once, the copy runs after the frame's draws on the GPU
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	free->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	free->width = width;
+	free->height = height;
+	free->path = path;
+	free->format = format;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	this->m_Stats.issueTime += std::chrono::duration<float, std::micro>(end - start).count();
+	return true;
+}
+
+void FrameCapture::update()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (unsigned int i = 0; i < this->m_Slots.size(); i++)
+	{
+		Slot& slot = this->m_Slots[i];
+		if (slot.fence == nullptr)
+		{
+			continue;
+		}
+
+		// Zero timeout: a readback that is not done yet is checked again next frame
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			continue;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		if (!this->m_Persistent)
+		{
+			GLsizeiptr size = static_cast<GLsizeiptr>(slot.width) * slot.height * 4;
+
+			GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+			if (data != nullptr)
+			{
+				slot.copy.assign(static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->m_Mutex);
+			slot.state = SlotState::Writing;
+			this->m_Queue.push_back(i);
+		}
+		this->m_WorkReady.notify_one();
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	this->m_Stats.issueTime += std::chrono::duration<float, std::micro>(end - start).count();
+}
+
+FrameCaptureStats FrameCapture::getStats() const
+{
+	std::lock_guard<std::mutex> lock(this->m_Mutex);
+	return this->m_Stats;
+}
+
+void FrameCapture::resetStats()
+{
+	std::lock_guard<std::mutex> lock(this->m_Mutex);
+	this->m_Stats.requested = 0;
+	this->m_Stats.written = 0;
+	this->m_Stats.dropped = 0;
+	this->m_Stats.issueTime = 0.0f;
+}
+
+void FrameCapture::allocate(Slot& slot, GLsizeiptr size)
+{
+	// Expects slot.buffer bound to GL_PIXEL_PACK_BUFFER
+	if (this->m_Persistent)
+	{
+		// Immutable storage cannot grow, the buffer is replaced
+		if (slot.mapped != nullptr)
+		{
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			glDeleteBuffers(1, &slot.buffer);
+			glGenBuffers(1, &slot.buffer);
+			GlState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		}
+
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags);
+		slot.mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags));
+	}
+	else
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+	}
+	slot.size = size;
+}
+
+void FrameCapture::workerLoop()
+{
+	while (true)
+	{
+		unsigned int index;
+		{
+			std::unique_lock<std::mutex> lock(this->m_Mutex);
+			this->m_WorkReady.wait(lock, [this] { return this->m_Stop || !this->m_Queue.empty(); });
+
+			if (this->m_Queue.empty())
+			{
+				return;
+			}
+			index = this->m_Queue.front();
+			this->m_Queue.pop_front();
+		}
+
+		// The GL thread leaves the slot alone until it is Free again
+		Slot& slot = this->m_Slots[index];
+		const unsigned char* pixels = this->m_Persistent ? slot.mapped : slot.copy.data();
+
+		bool written = false;
+		if (pixels != nullptr && (this->m_Persistent || !slot.copy.empty()))
+		{
+			written = slot.format == CaptureFormat::Png
+				? writePng(slot.path, pixels, slot.width, slot.height)
+				: writeRaw(slot.path, pixels, slot.width, slot.height);
+		}
+		if (!written)
+		{
+			std::cout << "ERROR::FRAME_CAPTURE::WRITE_FAILED " << slot.path << std::endl;
+		}
+
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		slot.state = SlotState::Free;
+		if (written)
+		{
+			this->m_Stats.written++;
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glad/glad.h"
+
+enum class CaptureFormat
+{
+	Png,	// RGBA, uncompressed deflate blocks
+	Raw		// RGBA rows, top row first
+};
+
+/*
+ * Counters accumulated since the last resetStats() call
+ */
+struct FrameCaptureStats
+{
+	unsigned int requested;
+	unsigned int written;
+	unsigned int dropped;
+	float issueTime; // microseconds spent in capture() and update()
+};
+
+/*
+ * Asynchronous readback of the framebuffer. capture() only queues a glReadPixels into a
+ * pixel buffer object of the ring and fences it; update() polls the fences without waiting
+ * and hands the finished slots to a worker thread, which writes the file. With GL 4.4 the
+ * buffers are persistently mapped and the worker reads them in place, otherwise update()
+ * copies them out. A capture is dropped when every slot is still busy, the frame never waits
+ */
+class FrameCapture
+{
+public:
+	explicit FrameCapture(unsigned int slotCount);
+
+	// Writes the pending captures before returning
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	/*
+	 * Reads width * height pixels of the read framebuffer once the commands issued so far
+	 * complete. Returns false when the capture was dropped
+	 */
+	bool capture(int width, int height, const std::string& path, CaptureFormat format);
+
+	/*
+	 * Once per frame, sends the slots whose readback finished to the worker
+	 */
+	void update();
+
+	// Copy, the worker updates the written count
+	FrameCaptureStats getStats() const;
+	void resetStats();
+
+private:
+	enum class SlotState
+	{
+		Free,
+		Reading,	// glReadPixels issued, waiting on the fence
+		Writing		// owned by the worker
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		GLsizeiptr size;
+		unsigned char* mapped;
+		std::vector<unsigned char> copy;
+
+		GLsync fence;
+		int width;
+		int height;
+		std::string path;
+		CaptureFormat format;
+
+		// Written by the worker once the file is done, under m_Mutex
+		SlotState state;
+	};
+
+	bool m_Persistent;
+	std::vector<Slot> m_Slots;
+
+	std::thread m_Worker;
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_WorkReady;
+	std::deque<unsigned int> m_Queue;
+	bool m_Stop;
+
+	FrameCaptureStats m_Stats;
+
+	void allocate(Slot& slot, GLsizeiptr size);
+	void workerLoop();
+};
@@ -0,0 +1,140 @@
+#include "frame_governor.h"
+
+#include <algorithm>
+
+/*
+ * Controller tuning
+ */
+// Frame time must leave the [target * (1 - H), target * (1 + H)] band before reacting
+static const float HYSTERESIS = 0.15f;
+// Consecutive frames outside the band needed to change the quality
+static const int REACTION_FRAMES = 10;
+static const float QUALITY_STEP = 0.05f;
+// Exponential moving average weight of the newest frame time
+static const float SMOOTHING = 0.1f;
+
+FrameGovernor::FrameGovernor(float targetFrameTime, const LodBudget& lowest, const LodBudget& highest)
+	: m_Frame(0)
+	, m_TargetFrameTime(targetFrameTime)
+	, m_Lowest(lowest)
+	, m_Highest(highest)
+	, m_Budget(highest)
+	, m_Quality(1.0f)
+	, m_CpuFrameTime(0.0f)
+	, m_GpuFrameTime(0.0f)
+	, m_SmoothedFrameTime(targetFrameTime)
+	, m_OverBudgetFrames(0)
+	, m_UnderBudgetFrames(0)
+{
+	glGenQueries(QUERY_COUNT, this->m_Queries);
+	std::fill(this->m_QueryIssued, this->m_QueryIssued + QUERY_COUNT, false);
+}
+
+FrameGovernor::~FrameGovernor()
+{
+	glDeleteQueries(QUERY_COUNT, this->m_Queries);
+}
+
+void FrameGovernor::beginFrame()
+{
+	this->m_CpuStart = std::chrono::steady_clock::now();
+
+	int current = this->m_Frame % QUERY_COUNT;
+	glBeginQuery(GL_TIME_ELAPSED, this->m_Queries[current]);
+}
+
+void FrameGovernor::endFrame()
+{
+	int current = this->m_Frame % QUERY_COUNT;
+	glEndQuery(GL_TIME_ELAPSED);
+	this->m_QueryIssued[current] = true;
+
+	std::chrono::duration<float, std::milli> cpuTime = std::chrono::steady_clock::now() - this->m_CpuStart;
+	this->m_CpuFrameTime = cpuTime.count();
+
+	this->m_Frame++;
+
+	this->readGpuTime();
+	this->updateQuality();
+}
+
+const LodBudget& FrameGovernor::getBudget() const
+{
+	return this->m_Budget;
+}
+
+float FrameGovernor::getQuality() const
+{
+	return this->m_Quality;
+}
+
+float FrameGovernor::getCpuFrameTime() const
+{
+	return this->m_CpuFrameTime;
+}
+
+float FrameGovernor::getGpuFrameTime() const
+{
+	return this->m_GpuFrameTime;
+}
+
+void FrameGovernor::readGpuTime()
+{
+	// The query about to be reused is the oldest one, QUERY_COUNT - 1 frames behind
+	int oldest = this->m_Frame % QUERY_COUNT;
+	if (!this->m_QueryIssued[oldest])
+	{
+		return;
+	}
+
+	GLint available = GL_FALSE;
+	glGetQueryObjectiv(this->m_Queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available == GL_FALSE)
+	{
+		return;
+	}
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(this->m_Queries[oldest], GL_QUERY_RESULT, &elapsed);
+	this->m_GpuFrameTime = elapsed / 1000000.0f;
+	this->m_QueryIssued[oldest] = false;
+}
+
+void FrameGovernor::updateQuality()
+{
+	float frameTime = std::max(this->m_CpuFrameTime, this->m_GpuFrameTime);
+	this->m_SmoothedFrameTime += (frameTime - this->m_SmoothedFrameTime) * SMOOTHING;
+
+	if (this->m_SmoothedFrameTime > this->m_TargetFrameTime * (1.0f + HYSTERESIS))
+	{
+		this->m_OverBudgetFrames++;
+		this->m_UnderBudgetFrames = 0;
+	}
+	else if (this->m_SmoothedFrameTime < this->m_TargetFrameTime * (1.0f - HYSTERESIS))
+	{
+		this->m_UnderBudgetFrames++;
+		this->m_OverBudgetFrames = 0;
+	}
+	else
+	{
+		this->m_OverBudgetFrames = 0;
+		this->m_UnderBudgetFrames = 0;
+	}
+
+	if (this->m_OverBudgetFrames >= REACTION_FRAMES)
+	{
+		this->m_Quality = std::max(this->m_Quality - QUALITY_STEP, 0.0f);
+		this->m_OverBudgetFrames = 0;
+	}
+	else if (this->m_UnderBudgetFrames >= REACTION_FRAMES)
+	{
+		this->m_Quality = std::min(this->m_Quality + QUALITY_STEP, 1.0f);
+		this->m_UnderBudgetFrames = 0;
+	}
+
+	float q = this->m_Quality;
+	this->m_Budget.minTessLevel = this->m_Lowest.minTessLevel + (this->m_Highest.minTessLevel - this->m_Lowest.minTessLevel) * q;
+	this->m_Budget.maxTessLevel = this->m_Lowest.maxTessLevel + (this->m_Highest.maxTessLevel - this->m_Lowest.maxTessLevel) * q;
+	this->m_Budget.minDistance = this->m_Lowest.minDistance + (this->m_Highest.minDistance - this->m_Lowest.minDistance) * q;
+	this->m_Budget.maxDistance = this->m_Lowest.maxDistance + (this->m_Highest.maxDistance - this->m_Lowest.maxDistance) * q;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+
+#include "glad/glad.h"
+
+/*
+ * Tessellation and LOD parameters consumed by the TCS
+ */
+struct LodBudget
+{
+	float minTessLevel;
+	float maxTessLevel;
+	float minDistance;
+	float maxDistance;
+};
+
+/*
+ * Measures the CPU and GPU (timer queries) frame time and moves the LOD budget
+ * between a lowest and a highest quality in order to hold a target frame time
+ */
+class FrameGovernor
+{
+public:
+	FrameGovernor(float targetFrameTime, const LodBudget& lowest, const LodBudget& highest);
+	~FrameGovernor();
+
+	FrameGovernor(const FrameGovernor&) = delete;
+	FrameGovernor& operator=(const FrameGovernor&) = delete;
+
+	void beginFrame();
+	void endFrame();
+
+	const LodBudget& getBudget() const;
+	float getQuality() const;
+	float getCpuFrameTime() const;
+	float getGpuFrameTime() const;
+
+private:
+	// Queries in flight, results are read a few frames later to avoid stalls
+	static const int QUERY_COUNT = 4;
+
+	GLuint m_Queries[QUERY_COUNT];
+	bool m_QueryIssued[QUERY_COUNT];
+	unsigned int m_Frame;
+
+	float m_TargetFrameTime;
+	LodBudget m_Lowest;
+	LodBudget m_Highest;
+	LodBudget m_Budget;
+
+	float m_Quality;
+	float m_CpuFrameTime;
+	float m_GpuFrameTime;
+	float m_SmoothedFrameTime;
+
+	int m_OverBudgetFrames;
+	int m_UnderBudgetFrames;
+
+	std::chrono::steady_clock::time_point m_CpuStart;
+
+	void readGpuTime();
+	void updateQuality();
+};
@@ -0,0 +1,281 @@
+#include "gl_state.h"
+
+GlState& GlState::get()
+{
+	static GlState state;
+	return state;
+}
+
+GlState::GlState()
+	: m_Stats()
+{
+	this->invalidate();
+}
+
+void GlState::useProgram(GLuint program)
+{
+	if (this->change(this->m_Program, program))
+	{
+		glUseProgram(program);
+	}
+}
+
+void GlState::bindVertexArray(GLuint vertexArray)
+{
+	if (this->change(this->m_VertexArray, vertexArray))
+	{
+		glBindVertexArray(vertexArray);
+
+		// The element buffer binding belongs to the VAO
+		this->m_Buffers[ELEMENT_ARRAY_BUFFER] = UNKNOWN;
+	}
+}
+
+void GlState::bindFramebuffer(GLuint framebuffer)
+{
+	if (this->change(this->m_Framebuffer, framebuffer))
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+}
+
+void GlState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	std::array<GLint, 4> viewport = { x, y, width, height };
+	if (viewport == this->m_Viewport)
+	{
+		this->m_Stats.skipped++;
+		return;
+	}
+
+	this->m_Stats.issued++;
+	this->m_Viewport = viewport;
+	glViewport(x, y, width, height);
+}
+
+void GlState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = getBufferTarget(target);
+	if (index < 0)
+	{
+		this->m_Stats.issued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (this->change(this->m_Buffers[index], buffer))
+	{
+		glBindBuffer(target, buffer);
+	}
+}
+
+void GlState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	// A whole buffer binding is stored with a zero size, a range never has one
+	this->bindBufferRange(target, index, buffer, 0, 0);
+}
+
+void GlState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	IndexedBinding* binding = this->getIndexedBinding(target, index);
+	if (binding != nullptr && binding->buffer == buffer && binding->offset == offset && binding->size == size)
+	{
+		this->m_Stats.skipped++;
+		return;
+	}
+
+	this->m_Stats.issued++;
+	if (size == 0)
+	{
+		glBindBufferBase(target, index, buffer);
+	}
+	else
+	{
+		glBindBufferRange(target, index, buffer, offset, size);
+	}
+
+	if (binding != nullptr)
+	{
+		*binding = { buffer, offset, size };
+	}
+
+	// Both calls also bind the buffer to the generic target
+	int generic = getBufferTarget(target);
+	if (generic >= 0)
+	{
+		this->m_Buffers[generic] = buffer;
+	}
+}
+
+void GlState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	if (this->change(this->m_ActiveTexture, unit))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	int index = getTextureTarget(target);
+	if (unit < MAX_TEXTURE_UNITS && index >= 0 && this->m_Textures[unit][index] == texture)
+	{
+		this->m_Stats.skipped++;
+		return;
+	}
+
+	this->m_Stats.issued++;
+	glBindTexture(target, texture);
+
+	if (unit < MAX_TEXTURE_UNITS && index >= 0)
+	{
+		this->m_Textures[unit][index] = texture;
+	}
+}
+
+void GlState::deleteTexture(GLuint texture)
+{
+	glDeleteTextures(1, &texture);
+
+	// GL unbinds it from every unit, the name may come back from glGenTextures
+	for (auto& unit : this->m_Textures)
+	{
+		for (GLuint& binding : unit)
+		{
+			if (binding == texture)
+			{
+				binding = UNKNOWN;
+			}
+		}
+	}
+}
+
+void GlState::polygonMode(GLenum mode)
+{
+	if (this->change(this->m_PolygonMode, mode))
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+}
+
+void GlState::setDepthTest(bool enabled)
+{
+	if (this->change(this->m_DepthTest, enabled ? GL_TRUE : GL_FALSE))
+	{
+		if (enabled)
+		{
+			glEnable(GL_DEPTH_TEST);
+		}
+		else
+		{
+			glDisable(GL_DEPTH_TEST);
+		}
+	}
+}
+
+void GlState::depthFunc(GLenum function)
+{
+	if (this->change(this->m_DepthFunc, function))
+	{
+		glDepthFunc(function);
+	}
+}
+
+void GlState::depthMask(GLboolean enabled)
+{
+	if (this->change(this->m_DepthMask, enabled))
+	{
+		glDepthMask(enabled);
+	}
+}
+
+void GlState::invalidate()
+{
+	this->m_Program = UNKNOWN;
+	this->m_VertexArray = UNKNOWN;
+	this->m_Framebuffer = UNKNOWN;
+	this->m_Viewport.fill(-1);
+	this->m_Buffers.fill(UNKNOWN);
+	this->m_StorageBindings.fill({ UNKNOWN, 0, 0 });
+	this->m_UniformBindings.fill({ UNKNOWN, 0, 0 });
+	this->m_ActiveTexture = UNKNOWN;
+	for (auto& unit : this->m_Textures)
+	{
+		unit.fill(UNKNOWN);
+	}
+	this->m_PolygonMode = UNKNOWN;
+	this->m_DepthTest = UNKNOWN;
+	this->m_DepthFunc = UNKNOWN;
+	this->m_DepthMask = UNKNOWN;
+}
+
+void GlState::endFrame()
+{
+	this->m_Stats.frames++;
+}
+
+const GlStateStats& GlState::getStats() const
+{
+	return this->m_Stats;
+}
+
+void GlState::resetStats()
+{
+	this->m_Stats = {};
+}
+
+bool GlState::change(GLuint& cached, GLuint value)
+{
+	if (cached == value)
+	{
+		this->m_Stats.skipped++;
+		return false;
+	}
+
+	this->m_Stats.issued++;
+	cached = value;
+	return true;
+}
+
+int GlState::getBufferTarget(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return ARRAY_BUFFER;
+	case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_ARRAY_BUFFER;
+	case GL_COPY_READ_BUFFER: return COPY_READ_BUFFER;
+	case GL_COPY_WRITE_BUFFER: return COPY_WRITE_BUFFER;
+	case GL_DRAW_INDIRECT_BUFFER: return DRAW_INDIRECT_BUFFER;
+	case GL_PARAMETER_BUFFER: return PARAMETER_BUFFER;
+	case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK_BUFFER;
+	case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK_BUFFER;
+	case GL_SHADER_STORAGE_BUFFER: return SHADER_STORAGE_BUFFER;
+	case GL_UNIFORM_BUFFER: return UNIFORM_BUFFER;
+	default: return -1;
+	}
+}
+
+int GlState::getTextureTarget(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return TEXTURE_2D;
+	case GL_TEXTURE_2D_ARRAY: return TEXTURE_2D_ARRAY;
+	default: return -1;
+	}
+}
+
+GlState::IndexedBinding* GlState::getIndexedBinding(GLenum target, GLuint index)
+{
+	if (index >= MAX_INDEXED_BINDINGS)
+	{
+		return nullptr;
+	}
+
+	if (target == GL_SHADER_STORAGE_BUFFER)
+	{
+		return &this->m_StorageBindings[index];
+	}
+	if (target == GL_UNIFORM_BUFFER)
+	{
+		return &this->m_UniformBindings[index];
+	}
+	return nullptr;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+
+#include "glad/glad.h"
+
+// Unit no shader samples, textures are bound to it while their storage is created or updated
+static const GLuint SETUP_TEXTURE_UNIT = 15;
+
+/*
+ * Counters accumulated since the last resetStats() call
+ */
+struct GlStateStats
+{
+	unsigned int frames;
+	unsigned int issued;
+	unsigned int skipped;
+};
+
+/*
+ * Shadow copy of the context state the renderer changes every frame: program, VAO,
+ * framebuffer and viewport, buffer bindings (plain and indexed), textures per unit,
+ * polygon mode and depth state.
+ * A call matching the cached value is skipped instead of reaching the driver.
+ * Everything must go through it: after raw GL calls changing the same state (or after
+ * deleting a bound object) call invalidate(). Targets it does not track are always issued
+ */
+class GlState
+{
+public:
+	/*
+	 * The state of the one context of the application
+	 */
+	static GlState& get();
+
+	GlState(const GlState&) = delete;
+	GlState& operator=(const GlState&) = delete;
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+
+	// Binds both the draw and the read framebuffer
+	void bindFramebuffer(GLuint framebuffer);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	void bindBuffer(GLenum target, GLuint buffer);
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	/*
+	 * Binds texture to the given unit (0 based), glActiveTexture is only issued when the unit changes.
+	 * The unit is left active even when the binding is cached, target based edits
+	 * (glTexSubImage*, glTexParameter*) right after the call reach texture
+	 */
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	/*
+	 * glDeleteTextures, the units holding texture forget it so a recycled name is bound again
+	 */
+	void deleteTexture(GLuint texture);
+
+	void polygonMode(GLenum mode);
+	void setDepthTest(bool enabled);
+	void depthFunc(GLenum function);
+	void depthMask(GLboolean enabled);
+
+	/*
+	 * Forgets the cached values, the next call of each kind is issued
+	 */
+	void invalidate();
+
+	// Only counts frames for the stats
+	void endFrame();
+
+	const GlStateStats& getStats() const;
+	void resetStats();
+
+private:
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+	static const unsigned int MAX_INDEXED_BINDINGS = 8;
+
+	// Cached values are reset to UNKNOWN, which no GL name or enum takes
+	static constexpr GLuint UNKNOWN = 0xFFFFFFFFu;
+
+	enum BufferTarget
+	{
+		ARRAY_BUFFER,
+		ELEMENT_ARRAY_BUFFER,
+		COPY_READ_BUFFER,
+		COPY_WRITE_BUFFER,
+		DRAW_INDIRECT_BUFFER,
+		PARAMETER_BUFFER,
+		PIXEL_PACK_BUFFER,
+		PIXEL_UNPACK_BUFFER,
+		SHADER_STORAGE_BUFFER,
+		UNIFORM_BUFFER,
+		BUFFER_TARGET_COUNT
+	};
+
+	enum TextureTarget
+	{
+		TEXTURE_2D,
+		TEXTURE_2D_ARRAY,
+		TEXTURE_TARGET_COUNT
+	};
+
+	struct IndexedBinding
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	GlStateStats m_Stats;
+
+	GLuint m_Program;
+	GLuint m_VertexArray;
+	GLuint m_Framebuffer;
+	std::array<GLint, 4> m_Viewport;
+	std::array<GLuint, BUFFER_TARGET_COUNT> m_Buffers;
+	std::array<IndexedBinding, MAX_INDEXED_BINDINGS> m_StorageBindings;
+	std::array<IndexedBinding, MAX_INDEXED_BINDINGS> m_UniformBindings;
+	GLuint m_ActiveTexture;
+	std::array<std::array<GLuint, TEXTURE_TARGET_COUNT>, MAX_TEXTURE_UNITS> m_Textures;
+	GLuint m_PolygonMode;
+	GLuint m_DepthTest;
+	GLuint m_DepthFunc;
+	GLuint m_DepthMask;
+
+	GlState();
+
+	// Returns false when the value is already current, otherwise stores it
+	bool change(GLuint& cached, GLuint value);
+
+	static int getBufferTarget(GLenum target);
+	static int getTextureTarget(GLenum target);
+	IndexedBinding* getIndexedBinding(GLenum target, GLuint index);
+};
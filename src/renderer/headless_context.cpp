@@ -0,0 +1,174 @@
+#ifdef HEADLESS
+
+#include "headless_context.h"
+
+#include <iostream>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "gl_state.h"
+
+// Context versions tried in order, the shaders need at least 4.1
+static const EGLint CONTEXT_VERSIONS[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 }, { 4, 3 }, { 4, 1 } };
+
+HeadlessContext::HeadlessContext(int width, int height)
+	: m_Display(EGL_NO_DISPLAY)
+	, m_Context(EGL_NO_CONTEXT)
+	, m_Width(width)
+	, m_Height(height)
+	, m_Framebuffer(0)
+	, m_ColorBuffer(0)
+	, m_DepthBuffer(0)
+{
+	if (!this->createContext())
+	{
+		return;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+	{
+		std::cout << "ERROR::HEADLESS::GLAD_LOAD_FAILED" << std::endl;
+		return;
+	}
+
+	this->createFramebuffer();
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	// Set once glad is loaded
+	if (this->m_ColorBuffer != 0)
+	{
+		glDeleteFramebuffers(1, &this->m_Framebuffer);
+		glDeleteRenderbuffers(1, &this->m_ColorBuffer);
+		glDeleteRenderbuffers(1, &this->m_DepthBuffer);
+	}
+
+	if (this->m_Display != EGL_NO_DISPLAY)
+	{
+		eglMakeCurrent(this->m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (this->m_Context != EGL_NO_CONTEXT)
+		{
+			eglDestroyContext(this->m_Display, this->m_Context);
+		}
+		eglTerminate(this->m_Display);
+	}
+}
+
+bool HeadlessContext::isValid() const
+{
+	return this->m_Framebuffer != 0;
+}
+
+GLuint HeadlessContext::getFramebuffer() const
+{
+	return this->m_Framebuffer;
+}
+
+int HeadlessContext::getWidth() const
+{
+	return this->m_Width;
+}
+
+int HeadlessContext::getHeight() const
+{
+	return this->m_Height;
+}
+
+bool HeadlessContext::createContext()
+{
+	// The surfaceless platform needs no X or Wayland server, the default display is the fallback
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if (getPlatformDisplay != nullptr)
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major = 0;
+	EGLint minor = 0;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		std::cout << "ERROR::HEADLESS::EGL_DISPLAY_UNAVAILABLE" << std::endl;
+		return false;
+	}
+	this->m_Display = display;
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "ERROR::HEADLESS::NO_OPENGL_API" << std::endl;
+		return false;
+	}
+
+	// Nothing is presented, so no config is needed where the driver allows it (Mesa's surfaceless platform has none)
+	const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+	{
+		config = EGL_NO_CONFIG_KHR;
+	}
+
+	for (const EGLint* version : CONTEXT_VERSIONS)
+	{
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, version[0],
+			EGL_CONTEXT_MINOR_VERSION, version[1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+
+		EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context != EGL_NO_CONTEXT)
+		{
+			this->m_Context = context;
+			break;
+		}
+	}
+
+	if (this->m_Context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->m_Context))
+	{
+		std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool HeadlessContext::createFramebuffer()
+{
+	glGenRenderbuffers(1, &this->m_ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->m_ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, this->m_Width, this->m_Height);
+
+	// Same precision the depth pyramid copies from a window's depth buffer
+	glGenRenderbuffers(1, &this->m_DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->m_DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, this->m_Width, this->m_Height);
+
+	GLuint framebuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	GlState::get().bindFramebuffer(framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->m_ColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->m_DepthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		GlState::get().bindFramebuffer(0);
+		glDeleteFramebuffers(1, &framebuffer);
+		return false;
+	}
+
+	// A context without a surface starts with an empty viewport
+	this->m_Framebuffer = framebuffer;
+	GlState::get().viewport(0, 0, this->m_Width, this->m_Height);
+	return true;
+}
+
+#endif // HEADLESS
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "glad/glad.h"
+
+/*
+ * OpenGL context without a window or a display, created through EGL (the surfaceless
+ * platform when available, e.g. Mesa's llvmpipe on GPU-less nodes). The frame goes to an
+ * FBO of any size standing in for the default framebuffer. Only built with HEADLESS
+ */
+class HeadlessContext
+{
+public:
+	/*
+	 * Makes the context current, loads GL through glad and creates the framebuffer
+	 */
+	HeadlessContext(int width, int height);
+	~HeadlessContext();
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	bool isValid() const;
+
+	GLuint getFramebuffer() const;
+	int getWidth() const;
+	int getHeight() const;
+
+private:
+	// EGLDisplay and EGLContext, the EGL headers stay out of the renderer
+	void* m_Display;
+	void* m_Context;
+
+	int m_Width;
+	int m_Height;
+
+	GLuint m_Framebuffer;
+	GLuint m_ColorBuffer;
+	GLuint m_DepthBuffer;
+
+	bool createContext();
+	bool createFramebuffer();
+};
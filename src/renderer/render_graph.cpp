@@ -0,0 +1,477 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "gl_state.h"
+
+static bool isStencilFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+static bool isDepthFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24
+		|| internalFormat == GL_DEPTH_COMPONENT32F || isStencilFormat(internalFormat);
+}
+
+// Pixel transfer format and type matching the internal format, the textures are never uploaded
+static void getTransferFormat(GLenum internalFormat, GLenum& format, GLenum& type)
+{
+	if (isStencilFormat(internalFormat))
+	{
+		format = GL_DEPTH_STENCIL;
+		type = internalFormat == GL_DEPTH32F_STENCIL8 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_UNSIGNED_INT_24_8;
+	}
+	else if (isDepthFormat(internalFormat))
+	{
+		format = GL_DEPTH_COMPONENT;
+		type = internalFormat == GL_DEPTH_COMPONENT32F ? GL_FLOAT : GL_UNSIGNED_INT;
+	}
+	else
+	{
+		format = GL_RGBA;
+		type = GL_UNSIGNED_BYTE;
+	}
+}
+
+void RenderGraph::PassBuilder::read(Resource resource)
+{
+	this->m_Graph.m_Passes[this->m_Pass].reads.push_back(resource);
+}
+
+void RenderGraph::PassBuilder::write(Resource resource)
+{
+	this->m_Graph.m_Passes[this->m_Pass].writes.push_back(resource);
+}
+
+void RenderGraph::PassBuilder::markSideEffect()
+{
+	this->m_Graph.m_Passes[this->m_Pass].sideEffect = true;
+}
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph& graph, unsigned int pass)
+	: m_Graph(graph), m_Pass(pass)
+{
+}
+
+RenderGraph::RenderGraph()
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	for (auto& framebuffer : this->m_Framebuffers)
+	{
+		glDeleteFramebuffers(1, &framebuffer.second);
+	}
+
+	for (PhysicalTexture& texture : this->m_Textures)
+	{
+		GlState::get().deleteTexture(texture.texture);
+	}
+}
+
+void RenderGraph::reset()
+{
+	this->m_Resources.clear();
+	this->m_Passes.clear();
+	this->m_Schedule.clear();
+}
+
+RenderGraph::Resource RenderGraph::importTexture(const char* name, GLuint texture)
+{
+	return this->addResource(name, ResourceKind::Texture, true, texture, {});
+}
+
+RenderGraph::Resource RenderGraph::importFramebuffer(const char* name, GLuint framebuffer, GLsizei width, GLsizei height)
+{
+	return this->addResource(name, ResourceKind::Framebuffer, true, framebuffer, { width, height, GL_NONE });
+}
+
+RenderGraph::Resource RenderGraph::createTexture(const char* name, const RenderGraphTextureDesc& desc)
+{
+	return this->addResource(name, ResourceKind::Texture, false, 0, desc);
+}
+
+RenderGraph::Resource RenderGraph::createHandle(const char* name)
+{
+	return this->addResource(name, ResourceKind::Handle, false, 0, {});
+}
+
+void RenderGraph::addPass(const char* name, const std::function<void(PassBuilder&)>& setup, std::function<void()> execute)
+{
+	PassNode pass {};
+	pass.name = name;
+	pass.execute = std::move(execute);
+	this->m_Passes.push_back(std::move(pass));
+
+	PassBuilder builder(*this, static_cast<unsigned int>(this->m_Passes.size() - 1));
+	setup(builder);
+}
+
+void RenderGraph::compile()
+{
+	this->cullPasses();
+
+	for (unsigned int p = 0; p < this->m_Passes.size(); p++)
+	{
+		if (!this->m_Passes[p].culled)
+		{
+			this->m_Schedule.push_back(p);
+		}
+	}
+
+	this->allocateTextures();
+
+	for (unsigned int p : this->m_Schedule)
+	{
+		this->prepareFramebuffer(this->m_Passes[p]);
+	}
+
+	this->logSchedule();
+}
+
+void RenderGraph::execute()
+{
+	for (unsigned int p : this->m_Schedule)
+	{
+		const PassNode& pass = this->m_Passes[p];
+		if (pass.bindsFramebuffer)
+		{
+			GlState::get().bindFramebuffer(pass.framebuffer);
+			GlState::get().viewport(0, 0, pass.width, pass.height);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		pass.execute();
+		std::chrono::duration<float, std::micro> time = std::chrono::steady_clock::now() - start;
+
+		RenderGraphPassTime& passTime = this->getPassTime(pass.name);
+		passTime.time += time.count();
+		passTime.runs++;
+	}
+}
+
+GLuint RenderGraph::getTexture(Resource resource) const
+{
+	return this->m_Resources[resource].object;
+}
+
+GLuint RenderGraph::getWriterFramebuffer(Resource texture) const
+{
+	GLuint framebuffer = 0;
+	for (unsigned int p : this->m_Schedule)
+	{
+		const PassNode& pass = this->m_Passes[p];
+		if (pass.bindsFramebuffer && std::find(pass.writes.begin(), pass.writes.end(), texture) != pass.writes.end())
+		{
+			framebuffer = pass.framebuffer;
+		}
+	}
+	return framebuffer;
+}
+
+const std::vector<RenderGraphPassTime>& RenderGraph::getPassTimes() const
+{
+	return this->m_PassTimes;
+}
+
+void RenderGraph::resetStats()
+{
+	this->m_PassTimes.clear();
+}
+
+RenderGraph::Resource RenderGraph::addResource(const char* name, ResourceKind kind, bool imported, GLuint object, const RenderGraphTextureDesc& desc)
+{
+	this->m_Resources.push_back({ name, kind, imported, object, desc, -1, -1 });
+	return static_cast<Resource>(this->m_Resources.size() - 1);
+}
+
+void RenderGraph::cullPasses()
+{
+	/*
+	 * Declaration order is a valid execution order, a single backward sweep finds the
+	 * passes whose outputs reach an imported resource or a side effect
+	 */
+	std::vector<bool> needed(this->m_Resources.size(), false);
+	for (auto pass = this->m_Passes.rbegin(); pass != this->m_Passes.rend(); ++pass)
+	{
+		bool keep = pass->sideEffect;
+		for (Resource resource : pass->writes)
+		{
+			keep = keep || this->m_Resources[resource].imported || needed[resource];
+		}
+
+		pass->culled = !keep;
+		if (keep)
+		{
+			for (Resource resource : pass->reads)
+			{
+				needed[resource] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::allocateTextures()
+{
+	std::vector<Resource> transient;
+	for (int position = 0; position < static_cast<int>(this->m_Schedule.size()); position++)
+	{
+		const PassNode& pass = this->m_Passes[this->m_Schedule[position]];
+		for (const std::vector<Resource>* resources : { &pass.reads, &pass.writes })
+		{
+			for (Resource resource : *resources)
+			{
+				ResourceNode& node = this->m_Resources[resource];
+				if (node.kind != ResourceKind::Texture || node.imported)
+				{
+					continue;
+				}
+
+				if (node.firstUse < 0)
+				{
+					node.firstUse = position;
+					transient.push_back(resource);
+				}
+				node.lastUse = position;
+			}
+		}
+	}
+
+	/*
+	 * Greedy aliasing in order of first use: a texture is free again once the last pass
+	 * using it ran. Only identical size and format can share one
+	 */
+	for (PhysicalTexture& texture : this->m_Textures)
+	{
+		texture.lastUse = -1;
+	}
+
+	for (Resource resource : transient)
+	{
+		ResourceNode& node = this->m_Resources[resource];
+		auto physical = std::find_if(this->m_Textures.begin(), this->m_Textures.end(), [&](const PhysicalTexture& texture)
+			{
+				return texture.desc == node.desc && texture.lastUse < node.firstUse;
+			});
+
+		if (physical == this->m_Textures.end())
+		{
+			PhysicalTexture texture { node.desc, 0, -1 };
+			glGenTextures(1, &texture.texture);
+			GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D, texture.texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+			// glTexStorage2D needs GL 4.2, the CPU path runs on 4.1
+			GLenum format = GL_NONE;
+			GLenum type = GL_NONE;
+			getTransferFormat(node.desc.internalFormat, format, type);
+			glTexImage2D(GL_TEXTURE_2D, 0, node.desc.internalFormat, node.desc.width, node.desc.height, 0, format, type, nullptr);
+			this->m_Textures.push_back(texture);
+			physical = this->m_Textures.end() - 1;
+		}
+
+		physical->lastUse = node.lastUse;
+		node.object = physical->texture;
+	}
+
+	// Textures no pass used this frame (e.g. the old size after a resize) are released
+	for (auto texture = this->m_Textures.begin(); texture != this->m_Textures.end();)
+	{
+		if (texture->lastUse >= 0)
+		{
+			++texture;
+			continue;
+		}
+
+		for (auto framebuffer = this->m_Framebuffers.begin(); framebuffer != this->m_Framebuffers.end();)
+		{
+			const std::vector<GLuint>& attachments = framebuffer->first;
+			if (std::find(attachments.begin(), attachments.end(), texture->texture) != attachments.end())
+			{
+				glDeleteFramebuffers(1, &framebuffer->second);
+				framebuffer = this->m_Framebuffers.erase(framebuffer);
+			}
+			else
+			{
+				++framebuffer;
+			}
+		}
+
+		GlState::get().deleteTexture(texture->texture);
+		texture = this->m_Textures.erase(texture);
+
+		// The names can come back from glGen*, the cache must not consider them bound
+		GlState::get().invalidate();
+	}
+}
+
+void RenderGraph::prepareFramebuffer(PassNode& pass)
+{
+	std::vector<GLuint> colorTextures;
+	GLuint depthTexture = 0;
+	GLenum depthAttachment = GL_DEPTH_ATTACHMENT;
+
+	for (Resource resource : pass.writes)
+	{
+		const ResourceNode& node = this->m_Resources[resource];
+		if (node.kind == ResourceKind::Framebuffer)
+		{
+			// An imported framebuffer takes the whole pass
+			pass.bindsFramebuffer = true;
+			pass.framebuffer = node.object;
+			pass.width = node.desc.width;
+			pass.height = node.desc.height;
+			return;
+		}
+
+		if (node.kind != ResourceKind::Texture || node.imported)
+		{
+			continue;
+		}
+
+		if (isDepthFormat(node.desc.internalFormat))
+		{
+			depthTexture = node.object;
+			depthAttachment = isStencilFormat(node.desc.internalFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		}
+		else
+		{
+			colorTextures.push_back(node.object);
+		}
+
+		pass.width = node.desc.width;
+		pass.height = node.desc.height;
+	}
+
+	if (colorTextures.empty() && depthTexture == 0)
+	{
+		pass.bindsFramebuffer = false;
+		return;
+	}
+
+	pass.bindsFramebuffer = true;
+	pass.framebuffer = this->getFramebuffer(colorTextures, depthTexture, depthAttachment);
+}
+
+GLuint RenderGraph::getFramebuffer(const std::vector<GLuint>& colorTextures, GLuint depthTexture, GLenum depthAttachment)
+{
+	// Keyed by the attached textures, a framebuffer is deleted along with any of them
+	std::vector<GLuint> key = colorTextures;
+	key.push_back(depthTexture);
+
+	auto cached = this->m_Framebuffers.find(key);
+	if (cached != this->m_Framebuffers.end())
+	{
+		return cached->second;
+	}
+
+	GLuint framebuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	GlState::get().bindFramebuffer(framebuffer);
+
+	std::vector<GLenum> drawBuffers;
+	for (std::size_t i = 0; i < colorTextures.size(); i++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i), GL_TEXTURE_2D, colorTextures[i], 0);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i));
+	}
+	if (depthTexture != 0)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, depthAttachment, GL_TEXTURE_2D, depthTexture, 0);
+	}
+
+	if (drawBuffers.empty())
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else
+	{
+		glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE" << std::endl;
+	}
+
+	this->m_Framebuffers.emplace(std::move(key), framebuffer);
+	return framebuffer;
+}
+
+void RenderGraph::logSchedule()
+{
+	std::string schedule;
+	for (unsigned int p : this->m_Schedule)
+	{
+		const PassNode& pass = this->m_Passes[p];
+		schedule += schedule.empty() ? "" : " -> ";
+		schedule += pass.name;
+		if (pass.bindsFramebuffer)
+		{
+			schedule += " (fbo " + std::to_string(pass.framebuffer) + ")";
+		}
+	}
+
+	std::string culled;
+	for (const PassNode& pass : this->m_Passes)
+	{
+		if (pass.culled)
+		{
+			culled += (culled.empty() ? "" : ", ") + pass.name;
+		}
+	}
+	if (!culled.empty())
+	{
+		schedule += ", culled: " + culled;
+	}
+
+	unsigned int transient = 0;
+	std::vector<GLuint> physical;
+	for (const ResourceNode& node : this->m_Resources)
+	{
+		if (node.kind == ResourceKind::Texture && !node.imported && node.firstUse >= 0)
+		{
+			transient++;
+			if (std::find(physical.begin(), physical.end(), node.object) == physical.end())
+			{
+				physical.push_back(node.object);
+			}
+		}
+	}
+	if (transient > 0)
+	{
+		schedule += ", " + std::to_string(transient) + " transient textures on " + std::to_string(physical.size());
+	}
+
+	if (schedule != this->m_LastSchedule)
+	{
+		std::cout << "[graph] " << schedule << std::endl;
+		this->m_LastSchedule = schedule;
+	}
+}
+
+RenderGraphPassTime& RenderGraph::getPassTime(const std::string& name)
+{
+	auto passTime = std::find_if(this->m_PassTimes.begin(), this->m_PassTimes.end(), [&](const RenderGraphPassTime& time)
+		{
+			return time.name == name;
+		});
+
+	if (passTime == this->m_PassTimes.end())
+	{
+		this->m_PassTimes.push_back({ name, 0.0f, 0 });
+		return this->m_PassTimes.back();
+	}
+
+	return *passTime;
+}
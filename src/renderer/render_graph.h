@@ -0,0 +1,173 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+
+/*
+ * Size and format of a texture allocated by the graph
+ */
+struct RenderGraphTextureDesc
+{
+	GLsizei width;
+	GLsizei height;
+	GLenum internalFormat;
+
+	bool operator==(const RenderGraphTextureDesc& other) const = default;
+};
+
+/*
+ * CPU time of a pass accumulated since the last resetStats() call
+ */
+struct RenderGraphPassTime
+{
+	std::string name;
+	float time; // microseconds
+	unsigned int runs;
+};
+
+/*
+ * Frame described as passes declaring the resources they read and write, rebuilt every
+ * frame. compile() keeps the passes contributing to an imported resource (or marked with
+ * side effects) in declaration order, then gives the transient textures whose lifetimes do
+ * not overlap the same GL texture when their size and format match. Passes writing transient
+ * textures or an imported framebuffer get it bound, with the viewport, before they run.
+ * Textures and framebuffers are kept while some frame uses them, a stable frame allocates nothing
+ */
+class RenderGraph
+{
+public:
+	using Resource = unsigned int;
+
+	class PassBuilder
+	{
+	public:
+		void read(Resource resource);
+		void write(Resource resource);
+
+		// Kept even when nothing reads its outputs, e.g. readbacks
+		void markSideEffect();
+
+	private:
+		friend class RenderGraph;
+
+		RenderGraph& m_Graph;
+		unsigned int m_Pass;
+
+		PassBuilder(RenderGraph& graph, unsigned int pass);
+	};
+
+	RenderGraph();
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	/*
+	 * Drops the passes and resources of the last frame
+	 */
+	void reset();
+
+	/*
+	 * Resources owned outside the graph, their writers are never culled
+	 */
+	Resource importTexture(const char* name, GLuint texture);
+	Resource importFramebuffer(const char* name, GLuint framebuffer, GLsizei width, GLsizei height);
+
+	/*
+	 * Texture only alive between its first writer and its last reader
+	 */
+	Resource createTexture(const char* name, const RenderGraphTextureDesc& desc);
+
+	/*
+	 * Dependency without a GL object, e.g. the visible patch list between culling and drawing
+	 */
+	Resource createHandle(const char* name);
+
+	void addPass(const char* name, const std::function<void(PassBuilder&)>& setup, std::function<void()> execute);
+
+	/*
+	 * Culls, schedules and allocates. The schedule is logged whenever it changes
+	 */
+	void compile();
+	void execute();
+
+	/*
+	 * GL texture behind a texture resource, valid after compile()
+	 */
+	GLuint getTexture(Resource resource) const;
+
+	/*
+	 * Framebuffer of the last pass writing a texture resource, e.g. to blit from, valid
+	 * after compile(). 0 when no scheduled pass writes it
+	 */
+	GLuint getWriterFramebuffer(Resource texture) const;
+
+	const std::vector<RenderGraphPassTime>& getPassTimes() const;
+	void resetStats();
+
+private:
+	enum class ResourceKind
+	{
+		Texture,
+		Framebuffer,
+		Handle
+	};
+
+	struct ResourceNode
+	{
+		std::string name;
+		ResourceKind kind;
+		bool imported;
+		GLuint object;
+		RenderGraphTextureDesc desc;
+
+		// Schedule positions of the first and last pass using it, for aliasing
+		int firstUse;
+		int lastUse;
+	};
+
+	struct PassNode
+	{
+		std::string name;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		std::function<void()> execute;
+		bool sideEffect;
+		bool culled;
+
+		// Bound before execute, none when the pass writes no texture or framebuffer
+		bool bindsFramebuffer;
+		GLuint framebuffer;
+		GLsizei width;
+		GLsizei height;
+	};
+
+	struct PhysicalTexture
+	{
+		RenderGraphTextureDesc desc;
+		GLuint texture;
+		int lastUse;
+	};
+
+	std::vector<ResourceNode> m_Resources;
+	std::vector<PassNode> m_Passes;
+	std::vector<unsigned int> m_Schedule;
+
+	std::vector<PhysicalTexture> m_Textures;
+	std::map<std::vector<GLuint>, GLuint> m_Framebuffers;
+
+	std::string m_LastSchedule;
+	std::vector<RenderGraphPassTime> m_PassTimes;
+
+	Resource addResource(const char* name, ResourceKind kind, bool imported, GLuint object, const RenderGraphTextureDesc& desc);
+	void cullPasses();
+	void allocateTextures();
+	void prepareFramebuffer(PassNode& pass);
+	GLuint getFramebuffer(const std::vector<GLuint>& colorTextures, GLuint depthTexture, GLenum depthAttachment);
+	void logSchedule();
+	RenderGraphPassTime& getPassTime(const std::string& name);
+};
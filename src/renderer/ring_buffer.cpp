@@ -0,0 +1,155 @@
+#include "ring_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "gl_state.h"
+
+// Timeout of each wait on a section fence (ns)
+static const GLuint64 FENCE_WAIT_TIMEOUT = 1000000;
+
+RingBuffer::RingBuffer(GLsizeiptr sectionSize, unsigned int sectionCount)
+	: m_Buffer(0)
+	, m_SectionSize(sectionSize)
+	, m_SectionCount(std::max(sectionCount, 1u))
+	, m_Mapped(nullptr)
+	, m_Section(0)
+	, m_Offset(0)
+	, m_CommittedOffset(0)
+	, m_Stats { 0, 0, 0, 0.0f, 0 }
+{
+	this->m_Fences.assign(this->m_SectionCount, nullptr);
+
+	GLsizeiptr size = this->m_SectionSize * this->m_SectionCount;
+
+	// The copy target keeps the VAO and the indirect bindings untouched
+	glGenBuffers(1, &this->m_Buffer);
+	GlState::get().bindBuffer(GL_COPY_WRITE_BUFFER, this->m_Buffer);
+
+	if (GLAD_GL_VERSION_4_4)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		this->m_Mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		this->m_Staging.resize(this->m_SectionSize);
+	}
+
+	GlState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+RingBuffer::~RingBuffer()
+{
+	for (GLsync fence : this->m_Fences)
+	{
+		glDeleteSync(fence);
+	}
+
+	if (this->m_Mapped != nullptr)
+	{
+		GlState::get().bindBuffer(GL_COPY_WRITE_BUFFER, this->m_Buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		GlState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	glDeleteBuffers(1, &this->m_Buffer);
+}
+
+void RingBuffer::beginFrame()
+{
+	this->m_Section = (this->m_Section + 1) % this->m_SectionCount;
+	this->m_Offset = 0;
+	this->m_CommittedOffset = 0;
+	this->m_Stats.frames++;
+
+	GLsync fence = this->m_Fences[this->m_Section];
+	if (fence == nullptr)
+	{
+		return;
+	}
+
+	// Zero timeout first: a signaled fence is the normal case and must not be counted
+	GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		do
+		{
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT);
+		} while (status == GL_TIMEOUT_EXPIRED);
+
+		std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		this->m_Stats.fenceWaits++;
+		this->m_Stats.waitTime += elapsed.count();
+	}
+
+	glDeleteSync(fence);
+	this->m_Fences[this->m_Section] = nullptr;
+}
+
+void* RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset)
+{
+	// Bindings check the alignment of the offset in the whole buffer, not in the section
+	GLsizeiptr sectionBegin = this->m_Section * this->m_SectionSize;
+	GLsizeiptr begin = (sectionBegin + this->m_Offset + alignment - 1) / alignment * alignment - sectionBegin;
+	if (begin + size > this->m_SectionSize)
+	{
+		this->m_Stats.overflows++;
+		return nullptr;
+	}
+
+	this->m_Offset = begin + size;
+	this->m_Stats.peakUsage = std::max(this->m_Stats.peakUsage, this->m_Offset);
+
+	offset = sectionBegin + begin;
+	if (this->m_Mapped != nullptr)
+	{
+		return this->m_Mapped + offset;
+	}
+
+	return this->m_Staging.data() + begin;
+}
+
+void RingBuffer::commit()
+{
+	if (this->m_Mapped != nullptr || this->m_CommittedOffset == this->m_Offset)
+	{
+		return;
+	}
+
+	GlState::get().bindBuffer(GL_COPY_WRITE_BUFFER, this->m_Buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, this->m_Section * this->m_SectionSize + this->m_CommittedOffset,
+		this->m_Offset - this->m_CommittedOffset, this->m_Staging.data() + this->m_CommittedOffset);
+	GlState::get().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	this->m_CommittedOffset = this->m_Offset;
+}
+
+void RingBuffer::endFrame()
+{
+	this->m_Fences[this->m_Section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint RingBuffer::getBuffer() const
+{
+	return this->m_Buffer;
+}
+
+bool RingBuffer::isPersistent() const
+{
+	return this->m_Mapped != nullptr;
+}
+
+const RingBufferStats& RingBuffer::getStats() const
+{
+	return this->m_Stats;
+}
+
+void RingBuffer::resetStats()
+{
+	this->m_Stats = { 0, 0, 0, 0.0f, 0 };
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "glad/glad.h"
+
+/*
+ * Counters accumulated since the last resetStats() call
+ */
+struct RingBufferStats
+{
+	unsigned int frames;
+	unsigned int fenceWaits;
+	unsigned int overflows;
+	float waitTime; // microseconds
+	GLsizeiptr peakUsage;
+};
+
+/*
+ * Ring of per-frame sections in one buffer for the data the CPU rewrites every frame.
+ * With GL 4.4 the storage is immutable and persistently mapped (coherent), so writes go
+ * straight to memory the GPU reads, without driver copies. A fence placed at the end of
+ * each frame guards its section; beginFrame() only blocks when the GPU still reads the
+ * section about to be reused, which the stats count as a fence wait (ring too small).
+ * Older contexts write to a CPU copy uploaded by commit()
+ */
+class RingBuffer
+{
+public:
+	RingBuffer(GLsizeiptr sectionSize, unsigned int sectionCount);
+	~RingBuffer();
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	/*
+	 * Moves to the next section, waiting on its fence when needed
+	 */
+	void beginFrame();
+
+	/*
+	 * Reserves size bytes in the current section and returns where to write them, offset
+	 * receives their position in the buffer. nullptr when the section is full
+	 */
+	void* allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+
+	/*
+	 * Makes the data written since the last call visible to GL, no-op when persistent
+	 */
+	void commit();
+
+	/*
+	 * Fences the current section, after the last draw reading it
+	 */
+	void endFrame();
+
+	GLuint getBuffer() const;
+	bool isPersistent() const;
+
+	const RingBufferStats& getStats() const;
+	void resetStats();
+
+private:
+	GLuint m_Buffer;
+	GLsizeiptr m_SectionSize;
+	unsigned int m_SectionCount;
+
+	unsigned char* m_Mapped;
+	std::vector<unsigned char> m_Staging;
+
+	std::vector<GLsync> m_Fences;
+	unsigned int m_Section;
+	GLsizeiptr m_Offset;
+	GLsizeiptr m_CommittedOffset;
+
+	RingBufferStats m_Stats;
+};
@@ -0,0 +1,8 @@
+// Shared by every program and written once per frame, see CameraUniforms
+layout (std140) uniform Camera
+{
+	mat4 uView;
+	mat4 uProjection;
+	mat4 uViewProjection;
+	vec4 uEyePosition;
+};
@@ -0,0 +1,5 @@
+// Heightmap value to height, set by the application (TERRAIN_HEIGHT_SCALE)
+#ifndef HEIGHT_SCALE
+#define HEIGHT_SCALE 64.0
+#define HEIGHT_OFFSET -16.0
+#endif
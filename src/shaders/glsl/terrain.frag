@@ -0,0 +1,12 @@
+#version 410 core
+in float Height;
+
+out vec4 FragColor;
+
+#include "height.glsl"
+
+void main()
+{
+	float hei = (Height - HEIGHT_OFFSET) / HEIGHT_SCALE;
+	FragColor = vec4(hei, hei, hei, 1.0f);
+}
@@ -0,0 +1,56 @@
+#version 410 core
+/*
+ * Also built with a "#version 460 core" preamble defining DRAW_DATA, the vertex shader
+ * then reads the record of its draw by gl_DrawID. INSTANCED builds every patch from the
+ * unit patch and its instance record, see PatchInstancer
+ */
+#ifdef INSTANCED
+layout (location = 0) in vec2 aCorner;
+layout (location = 2) in uvec4 aPatch; // first grid vertex (xy) and span in patches (zw)
+
+// Position of grid vertex (0, 0), offset between vertices and vertices per side
+uniform vec2 uGridOrigin;
+uniform vec2 uGridStep;
+uniform float uGridResolution;
+#else
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+#endif
+
+out vec2 TexCoord;
+out float LodScale;
+
+#ifdef DRAW_DATA
+// Written next to the indirect commands, see ChunkDrawData
+struct DrawRecord
+{
+	vec2 offset;
+	float lodScale;
+};
+
+layout (std430, binding = 3) readonly buffer DrawData
+{
+	DrawRecord draws[];
+};
+#endif
+
+void main()
+{
+#ifdef INSTANCED
+	vec2 vertex = vec2(aPatch.xy) + aCorner * vec2(aPatch.zw);
+	vec3 position = vec3(uGridOrigin.x + vertex.x * uGridStep.x, 0.0, uGridOrigin.y + vertex.y * uGridStep.y);
+	TexCoord = vertex / uGridResolution;
+#else
+	vec3 position = aPos;
+	TexCoord = aTex;
+#endif
+
+#ifdef DRAW_DATA
+	DrawRecord record = draws[gl_DrawID];
+	gl_Position = vec4(position + vec3(record.offset.x, 0.0, record.offset.y), 1.0f);
+	LodScale = record.lodScale;
+#else
+	gl_Position = vec4(position, 1.0f);
+	LodScale = 1.0;
+#endif
+}
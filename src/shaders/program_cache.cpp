@@ -0,0 +1,262 @@
+#include "program_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// Directory of the binaries, next to the textures directory of the working directory
+static const char* CACHE_DIRECTORY = "shader_cache";
+
+static const std::uint32_t CACHE_MAGIC = 0x4E494250; // "PBIN"
+
+// A larger length is a corrupt header, not read
+static const std::uint64_t MAX_BINARY_SIZE = 64ull << 20;
+
+// Binaries kept, the least recently used beyond this are deleted at startup
+static const std::size_t MAX_CACHED_PROGRAMS = 64;
+
+// A temporary file this old was left by an instance that did not finish writing it
+static const std::chrono::hours STALE_TEMPORARY_AGE(1);
+
+/*
+ * File header, the binary follows
+ */
+struct ProgramBinaryHeader
+{
+	std::uint32_t magic;
+	std::uint32_t format;
+	std::uint64_t key;
+	std::uint64_t length;
+};
+
+// FNV-1a, 64 bit
+static std::uint64_t hashBytes(std::uint64_t hash, std::string_view bytes)
+{
+	for (unsigned char c : bytes)
+	{
+		hash ^= c;
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static int getProcessId()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return getpid();
+#endif
+}
+
+static std::string_view getString(GLenum name)
+{
+	const GLubyte* value = glGetString(name);
+	return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+}
+
+ProgramCache& ProgramCache::get()
+{
+	static ProgramCache cache;
+	return cache;
+}
+
+ProgramCache::ProgramCache()
+	: m_Directory(CACHE_DIRECTORY)
+	, m_FormatCount(0)
+	, m_Stats { 0, 0, 0, 0.0f }
+{
+	// Created on first use, once the context is current
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &this->m_FormatCount);
+
+	this->m_Driver.append(getString(GL_VENDOR)).append("\n");
+	this->m_Driver.append(getString(GL_RENDERER)).append("\n");
+	this->m_Driver.append(getString(GL_VERSION)).append("\n");
+
+	this->prune();
+}
+
+std::uint64_t ProgramCache::makeKey(const std::vector<std::string>& sources)
+{
+	std::uint64_t hash = hashBytes(0xCBF29CE484222325ull, this->m_Driver);
+	for (const std::string& source : sources)
+	{
+		// The separator keeps "ab" + "c" apart from "a" + "bc"
+		hash = hashBytes(hash, source);
+		hash = hashBytes(hash, std::string_view("\0", 1));
+	}
+	return hash;
+}
+
+bool ProgramCache::load(GLuint program, std::uint64_t key)
+{
+	this->m_Stats.programs++;
+	if (!this->isAvailable())
+	{
+		return false;
+	}
+
+	std::ifstream file(this->getPath(key), std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	ProgramBinaryHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	bool valid = file && header.magic == CACHE_MAGIC && header.key == key && header.length <= MAX_BINARY_SIZE;
+	std::vector<char> binary(valid ? static_cast<std::size_t>(header.length) : 0);
+	file.read(binary.data(), static_cast<std::streamsize>(binary.size()));
+
+	GLint success = GL_FALSE;
+	if (valid && file)
+	{
+		glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+	}
+
+	if (!success)
+	{
+		file.close();
+		std::error_code error;
+		std::filesystem::remove(this->getPath(key), error);
+		this->m_Stats.rejected++;
+		return false;
+	}
+
+	// Marks the binary as used, prune() keeps the most recent ones
+	std::error_code error;
+	std::filesystem::last_write_time(this->getPath(key), std::filesystem::file_time_type::clock::now(), error);
+
+	this->m_Stats.hits++;
+	return true;
+}
+
+void ProgramCache::store(GLuint program, std::uint64_t key)
+{
+	if (!this->isAvailable())
+	{
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	ProgramBinaryHeader header = { CACHE_MAGIC, GL_NONE, key, 0 };
+	std::vector<char> binary(static_cast<std::size_t>(length));
+	GLsizei written = 0;
+	GLenum format = GL_NONE;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+	{
+		return;
+	}
+	header.format = format;
+	header.length = static_cast<std::uint64_t>(written);
+
+	std::error_code error;
+	std::filesystem::create_directories(this->m_Directory, error);
+
+	// Written aside and renamed, a second instance never reads half a file. The name is per
+	// process, two instances storing the same key do not write to the same file
+	std::string path = this->getPath(key);
+	std::string temporary = path + "." + std::to_string(getProcessId()) + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), written);
+		if (!file)
+		{
+			return;
+		}
+	}
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		std::filesystem::remove(temporary, error);
+	}
+}
+
+void ProgramCache::remove(std::uint64_t key)
+{
+	std::error_code error;
+	std::filesystem::remove(this->getPath(key), error);
+}
+
+bool ProgramCache::isAvailable() const
+{
+	return this->m_FormatCount > 0;
+}
+
+void ProgramCache::addBuildTime(float time)
+{
+	this->m_Stats.buildTime += time;
+}
+
+const ProgramCacheStats& ProgramCache::getStats() const
+{
+	return this->m_Stats;
+}
+
+std::string ProgramCache::getPath(std::uint64_t key) const
+{
+	std::ostringstream name;
+	name << this->m_Directory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return name.str();
+}
+
+void ProgramCache::prune() const
+{
+	std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> binaries;
+	std::filesystem::file_time_type now = std::filesystem::file_time_type::clock::now();
+
+	std::error_code error;
+	for (std::filesystem::directory_iterator entry(this->m_Directory, error), end; !error && entry != end; entry.increment(error))
+	{
+		std::error_code timeError;
+		std::filesystem::file_time_type time = entry->last_write_time(timeError);
+		if (timeError)
+		{
+			continue;
+		}
+
+		std::filesystem::path extension = entry->path().extension();
+		if (extension == ".bin")
+		{
+			binaries.emplace_back(time, entry->path());
+		}
+		else if (extension == ".tmp" && now - time > STALE_TEMPORARY_AGE)
+		{
+			std::filesystem::remove(entry->path(), timeError);
+		}
+	}
+
+	if (binaries.size() <= MAX_CACHED_PROGRAMS)
+	{
+		return;
+	}
+
+	// Most recently used first
+	std::sort(binaries.begin(), binaries.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+	for (std::size_t i = MAX_CACHED_PROGRAMS; i < binaries.size(); i++)
+	{
+		std::filesystem::remove(binaries[i].second, error);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "glad/glad.h"
+
+/*
+ * Counters accumulated since the program started
+ */
+struct ProgramCacheStats
+{
+	unsigned int programs;
+	unsigned int hits;
+	unsigned int rejected; // stale binaries the driver refused, compiled again
+	float buildTime; // microseconds, compiling or loading every program
+};
+
+/*
+ * Linked program binaries kept on disk between runs. A binary is stored under a hash of
+ * the final stage sources and of the driver (vendor, renderer, version), so editing a
+ * shader or updating the driver selects another file instead of loading a stale one.
+ * A binary the driver still refuses (format mismatch) is deleted and compiled again.
+ * Only the most recently used binaries are kept, older ones are deleted at startup.
+ * Needs at least one binary format, otherwise every call is a miss
+ */
+class ProgramCache
+{
+public:
+	/*
+	 * The cache of the one context of the application
+	 */
+	static ProgramCache& get();
+
+	ProgramCache(const ProgramCache&) = delete;
+	ProgramCache& operator=(const ProgramCache&) = delete;
+
+	std::uint64_t makeKey(const std::vector<std::string>& sources);
+
+	/*
+	 * Loads the binary of key into program, true when it links.
+	 * On false program is left for the regular compile and link
+	 */
+	bool load(GLuint program, std::uint64_t key);
+
+	/*
+	 * Writes the binary of a linked program, created with the retrievable hint
+	 */
+	void store(GLuint program, std::uint64_t key);
+
+	/*
+	 * Deletes the binary of key, e.g. of a program replaced by a reload
+	 */
+	void remove(std::uint64_t key);
+
+	bool isAvailable() const;
+
+	void addBuildTime(float time);
+	const ProgramCacheStats& getStats() const;
+
+private:
+	std::string m_Directory;
+	std::string m_Driver;
+	GLint m_FormatCount;
+	ProgramCacheStats m_Stats;
+
+	ProgramCache();
+
+	std::string getPath(std::uint64_t key) const;
+	void prune() const;
+};
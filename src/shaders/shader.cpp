@@ -1,49 +1,133 @@
 #include "shader.h"
 
+#include <chrono>
+#include <cstring>
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include "program_cache.h"
+#include "../renderer/gl_state.h"
+
+// GL_COMPLETION_STATUS_KHR of KHR/ARB_parallel_shader_compile, the glad header has no extensions
+static const GLenum COMPLETION_STATUS = 0x91B1;
+
+// Preamble in place of the first line, #version must come before anything else
+static std::string applyPreamble(const char* source, const char* preamble)
+{
+	if (preamble == nullptr)
+	{
+		return source;
+	}
+
+	// The #line keeps the line numbers of driver errors those of the file, whose
+	// line 1 was the #version the preamble replaced
+	std::string result(preamble);
+	if (!result.empty() && result.back() != '\n')
+	{
+		result += '\n';
+	}
+	result += "#line 2\n";
+
+	const char* body = std::strchr(source, '\n');
+	return result + (body != nullptr ? body + 1 : "");
+}
+
+/*
+ * With the extension the driver compiles and links on its own threads and the completion
+ * status can be polled, otherwise the first status query waits for the build
+ */
+static bool hasParallelCompile()
+{
+	static int supported = -1;
+	if (supported < 0)
+	{
+		supported = 0;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+			if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+			{
+				supported = 1;
+				break;
+			}
+		}
+	}
+	return supported != 0;
+}
+
+static const char* getStageName(GLenum shaderType)
+{
+	switch (shaderType)
+	{
+	case GL_VERTEX_SHADER:
+		return "VERTEX";
+	case GL_FRAGMENT_SHADER:
+		return "FRAGMENT";
+	case GL_TESS_CONTROL_SHADER:
+		return "TESSELLETION_CONTROL";
+	case GL_TESS_EVALUATION_SHADER:
+		return "TESSELLETION_EVALUATION";
+	case GL_COMPUTE_SHADER:
+		return "COMPUTE";
+	default:
+		return "UNKNOWN";
+	}
+}
+
 Shader::Shader(
 	const char* vertexSource,
 	const char* fragmentSource,
 	const char* tessControlShaderSource,
-	const char* tessEvaluationShaderSource)
+	const char* tessEvaluationShaderSource,
+	const char* preamble,
+	ShaderBuild build)
 {
-	this->m_Id = glCreateProgram();
-
-	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, &vertexSource);
-	glAttachShader(this->m_Id, vertexShader);
-
-	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, &fragmentSource);
-	glAttachShader(this->m_Id, fragmentShader);
-
-	GLuint tessControlShader;
+	std::vector<ShaderStage> stages;
+	stages.push_back({ GL_VERTEX_SHADER, applyPreamble(vertexSource, preamble) });
+	stages.push_back({ GL_FRAGMENT_SHADER, applyPreamble(fragmentSource, preamble) });
 	if (tessControlShaderSource != nullptr)
 	{
-		tessControlShader = compileShader(GL_TESS_CONTROL_SHADER, &tessControlShaderSource);
-		glAttachShader(this->m_Id, tessControlShader);
+		stages.push_back({ GL_TESS_CONTROL_SHADER, applyPreamble(tessControlShaderSource, preamble) });
 	}
-
-	GLuint tessEvaluationShader;
 	if (tessEvaluationShaderSource != nullptr)
 	{
-		tessEvaluationShader = compileShader(GL_TESS_EVALUATION_SHADER, &tessEvaluationShaderSource);
-		glAttachShader(this->m_Id, tessEvaluationShader);
+		stages.push_back({ GL_TESS_EVALUATION_SHADER, applyPreamble(tessEvaluationShaderSource, preamble) });
 	}
 
-	glLinkProgram(this->m_Id);
+	this->build(stages, build);
+}
 
-	GLint success;
-	GLchar infoLog[512];
+Shader::Shader(const char* computeSource)
+{
+	this->build({ { GL_COMPUTE_SHADER, computeSource } }, ShaderBuild::Blocking);
+}
 
-	glGetProgramiv(this->m_Id, GL_LINK_STATUS, &success);
-	if (!success)
+Shader::Shader(const char* computeSource, const std::string& preamble)
+{
+	this->build({ { GL_COMPUTE_SHADER, applyPreamble(computeSource, preamble.c_str()) } }, ShaderBuild::Blocking);
+}
+
+Shader::~Shader()
+{
+	for (const std::pair<GLenum, GLuint>& shader : this->m_PendingShaders)
 	{
-		glGetProgramInfoLog(this->m_Id, sizeof(infoLog), nullptr, infoLog);
-		std::cout << "ERROR::PROGRAM::LINKING_FAILED" << std::endl << infoLog << std::endl;
+		glDeleteShader(shader.second);
 	}
+	glDeleteProgram(this->m_Id);
 
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
-	glDeleteShader(tessControlShader);
-	glDeleteShader(tessEvaluationShader);
+	// The name may be reused by the next program
+	GlState::get().invalidate();
+}
+
+void Shader::swap(Shader& other)
+{
+	std::swap(this->m_Id, other.m_Id);
+	std::swap(this->m_State, other.m_State);
+	std::swap(this->m_Uniforms, other.m_Uniforms);
+	std::swap(this->m_PendingShaders, other.m_PendingShaders);
+	std::swap(this->m_CacheKey, other.m_CacheKey);
 }
 
 GLuint Shader::getId() const
@@ -51,49 +135,205 @@ GLuint Shader::getId() const
 	return this->m_Id;
 }
 
+std::uint64_t Shader::getCacheKey() const
+{
+	return this->m_CacheKey;
+}
+
 void Shader::useProgram()
 {
-	glUseProgram(this->m_Id);
+	if (this->m_State == ShaderState::Building)
+	{
+		this->finishBuild();
+	}
+	GlState::get().useProgram(this->m_Id);
 }
 
-void Shader::setUniformBool(const std::string& name, GLboolean value) const
+bool Shader::isReady()
 {
-	glUniform1i(glGetUniformLocation(this->m_Id, name.c_str()), (GLint)value);
+	if (this->m_State == ShaderState::Building)
+	{
+		if (hasParallelCompile())
+		{
+			GLint completed = GL_FALSE;
+			glGetProgramiv(this->m_Id, COMPLETION_STATUS, &completed);
+			if (!completed)
+			{
+				return false;
+			}
+		}
+		this->finishBuild();
+	}
+
+	return this->m_State == ShaderState::Ready;
 }
 
-void Shader::setUniformInt(const std::string& name, GLint value) const
+bool Shader::hasFailed() const
 {
-	glUniform1i(glGetUniformLocation(this->m_Id, name.c_str()), value);
+	return this->m_State == ShaderState::Failed;
 }
 
-void Shader::setUniformFloat(const std::string& name, GLfloat value) const
+UniformHandle Shader::getUniform(std::string_view name) const
 {
-	glUniform1f(glGetUniformLocation(this->m_Id, name.c_str()), value);
+	auto uniform = this->m_Uniforms.find(name);
+	if (uniform == this->m_Uniforms.end())
+	{
+		return { -1, GL_NONE };
+	}
+
+	return uniform->second;
 }
 
-GLuint Shader::compileShader(GLenum shaderType, const GLchar* const* shaderSourceCode) const
+void Shader::setUniformBool(UniformHandle uniform, GLboolean value) const
 {
-	GLuint shader = glCreateShader(shaderType);
-	glShaderSource(shader, 1, shaderSourceCode, nullptr);
-	glCompileShader(shader);
+	if (this->checkUniformType(uniform, GL_BOOL))
+	{
+		glUniform1i(uniform.location, (GLint)value);
+	}
+}
+
+void Shader::setUniformInt(UniformHandle uniform, GLint value) const
+{
+	if (this->checkUniformType(uniform, GL_INT))
+	{
+		glUniform1i(uniform.location, value);
+	}
+}
+
+void Shader::setUniformFloat(UniformHandle uniform, GLfloat value) const
+{
+	if (this->checkUniformType(uniform, GL_FLOAT))
+	{
+		glUniform1f(uniform.location, value);
+	}
+}
+
+void Shader::setUniformVec2(UniformHandle uniform, const glm::vec2& value) const
+{
+	if (this->checkUniformType(uniform, GL_FLOAT_VEC2))
+	{
+		glUniform2fv(uniform.location, 1, glm::value_ptr(value));
+	}
+}
+
+void Shader::setUniformVec3(UniformHandle uniform, const glm::vec3& value) const
+{
+	if (this->checkUniformType(uniform, GL_FLOAT_VEC3))
+	{
+		glUniform3fv(uniform.location, 1, glm::value_ptr(value));
+	}
+}
+
+void Shader::setUniformVec4Array(UniformHandle uniform, const glm::vec4* values, GLsizei count) const
+{
+	if (this->checkUniformType(uniform, GL_FLOAT_VEC4))
+	{
+		glUniform4fv(uniform.location, count, glm::value_ptr(values[0]));
+	}
+}
 
-	if (shaderType == GL_VERTEX_SHADER)
+void Shader::setUniformMat4(UniformHandle uniform, const glm::mat4& value) const
+{
+	if (this->checkUniformType(uniform, GL_FLOAT_MAT4))
 	{
-		this->checkCompileErros(shader, "VERTEX");
+		glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
 	}
-	else if (shaderType == GL_FRAGMENT_SHADER)
+}
+
+void Shader::setUniformBool(std::string_view name, GLboolean value) const
+{
+	this->setUniformBool(this->getUniform(name), value);
+}
+
+void Shader::setUniformInt(std::string_view name, GLint value) const
+{
+	this->setUniformInt(this->getUniform(name), value);
+}
+
+void Shader::setUniformFloat(std::string_view name, GLfloat value) const
+{
+	this->setUniformFloat(this->getUniform(name), value);
+}
+
+void Shader::build(const std::vector<ShaderStage>& stages, ShaderBuild build)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	this->m_Id = glCreateProgram();
+	this->m_State = ShaderState::Building;
+
+	std::vector<std::string> sources;
+	for (const ShaderStage& stage : stages)
 	{
-		this->checkCompileErros(shader, "FRAGMENT");
+		// The stage type is part of the key, the same text may be built as another stage
+		sources.push_back(std::to_string(stage.type) + stage.source);
 	}
-	else if (shaderType == GL_TESS_CONTROL_SHADER)
+
+	ProgramCache& cache = ProgramCache::get();
+	this->m_CacheKey = cache.makeKey(sources);
+	if (cache.load(this->m_Id, this->m_CacheKey))
 	{
-		this->checkCompileErros(shader, "TESSELLETION_CONTROL");
+		this->reflectProgram();
+		this->m_State = ShaderState::Ready;
 	}
-	else if (shaderType == GL_TESS_EVALUATION_SHADER)
+	else
 	{
-		this->checkCompileErros(shader, "TESSELLETION_EVALUATION");
+		// Statuses are only queried by finishBuild(), a query before would wait for the driver
+		for (const ShaderStage& stage : stages)
+		{
+			GLuint shader = this->compileShader(stage.type, stage.source);
+			glAttachShader(this->m_Id, shader);
+			this->m_PendingShaders.push_back({ stage.type, shader });
+		}
+
+		glProgramParameteri(this->m_Id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(this->m_Id);
 	}
 
+	cache.addBuildTime(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+	if (build == ShaderBuild::Blocking && this->m_State == ShaderState::Building)
+	{
+		this->finishBuild();
+	}
+}
+
+void Shader::finishBuild()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (const std::pair<GLenum, GLuint>& shader : this->m_PendingShaders)
+	{
+		this->checkCompileErros(shader.second, getStageName(shader.first));
+	}
+
+	if (this->checkLinkStatus())
+	{
+		this->reflectProgram();
+		ProgramCache::get().store(this->m_Id, this->m_CacheKey);
+		this->m_State = ShaderState::Ready;
+	}
+	else
+	{
+		this->m_State = ShaderState::Failed;
+	}
+
+	for (const std::pair<GLenum, GLuint>& shader : this->m_PendingShaders)
+	{
+		glDetachShader(this->m_Id, shader.second);
+		glDeleteShader(shader.second);
+	}
+	this->m_PendingShaders.clear();
+
+	ProgramCache::get().addBuildTime(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+}
+
+GLuint Shader::compileShader(GLenum shaderType, const std::string& shaderSourceCode) const
+{
+	GLuint shader = glCreateShader(shaderType);
+	const GLchar* source = shaderSourceCode.c_str();
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
 	return shader;
 }
 
@@ -108,4 +348,83 @@ GLvoid Shader::checkCompileErros(GLuint shader, const std::string name) const
 		glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
 		std::cout << "ERROR::SHADER::" << name << "::COMPILATION_FAILED" << std::endl << infoLog << std::endl;
 	}
-}
\ No newline at end of file
+}
+
+bool Shader::checkLinkStatus() const
+{
+	GLint success;
+	GLchar infoLog[512];
+
+	glGetProgramiv(this->m_Id, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(this->m_Id, sizeof(infoLog), nullptr, infoLog);
+		std::cout << "ERROR::PROGRAM::LINKING_FAILED" << std::endl << infoLog << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void Shader::reflectProgram()
+{
+	/*
+	 * Uniform table, block members have no location and are left out
+	 */
+	GLint uniformCount = 0;
+	glGetProgramiv(this->m_Id, GL_ACTIVE_UNIFORMS, &uniformCount);
+	for (GLint i = 0; i < uniformCount; i++)
+	{
+		GLchar name[256];
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveUniform(this->m_Id, static_cast<GLuint>(i), sizeof(name), &length, &size, &type, name);
+
+		GLint location = glGetUniformLocation(this->m_Id, name);
+		if (location < 0)
+		{
+			continue;
+		}
+
+		// Arrays are reported as "name[0]"
+		std::string uniformName(name, length);
+		if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+		{
+			uniformName.resize(uniformName.size() - 3);
+		}
+
+		this->m_Uniforms[uniformName] = { location, type };
+	}
+
+	GLuint cameraBlock = glGetUniformBlockIndex(this->m_Id, "Camera");
+	if (cameraBlock != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(this->m_Id, cameraBlock, CAMERA_BLOCK_BINDING);
+	}
+}
+
+bool Shader::checkUniformType(UniformHandle uniform, GLenum type) const
+{
+	if (uniform.location < 0)
+	{
+		return false;
+	}
+	if (uniform.type == type)
+	{
+		return true;
+	}
+
+	// Samplers are set with their texture unit
+	bool isSampler = uniform.type == GL_SAMPLER_2D || uniform.type == GL_SAMPLER_2D_ARRAY || uniform.type == GL_SAMPLER_3D
+		|| uniform.type == GL_SAMPLER_CUBE || uniform.type == GL_SAMPLER_2D_SHADOW || uniform.type == GL_INT_SAMPLER_2D
+		|| uniform.type == GL_UNSIGNED_INT_SAMPLER_2D;
+	if (type == GL_INT && isSampler)
+	{
+		return true;
+	}
+
+	std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH" << std::endl << "location " << uniform.location << " has type 0x"
+		<< std::hex << uniform.type << ", set as 0x" << type << std::dec << std::endl;
+	return false;
+}
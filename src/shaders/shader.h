@@ -1,29 +1,148 @@
 #pragma once
 
+#include <cstdint>
+#include <map>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <iostream>
 
 #include "glad/glad.h"
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
 
+/*
+ * Binding point of the std140 "Camera" block, attached to every program declaring it
+ */
+static const GLuint CAMERA_BLOCK_BINDING = 0;
+
+/*
+ * Location and GLSL type of an active uniform. Handles are looked up once and then
+ * passed to the setters, which only check the type before the glUniform* call.
+ * A location of -1 (uniform not active) makes the setters no-ops, like glUniform*
+ */
+struct UniformHandle
+{
+	GLint location;
+	GLenum type;
+};
+
+/*
+ * One stage of a program, its final source (preamble applied)
+ */
+struct ShaderStage
+{
+	GLenum type;
+	std::string source;
+};
+
+/*
+ * A blocking build returns with the program linked. An async build only issues the
+ * compile and link, isReady() tells when it is done, meanwhile another program is drawn
+ */
+enum class ShaderBuild
+{
+	Blocking,
+	Async
+};
+
+/*
+ * Linked programs go through the ProgramCache, a warm start loads the binaries of the
+ * last run instead of compiling
+ */
 class Shader
 {
 public:
+	/*
+	 * A preamble replaces the #version line of every stage, e.g. to raise the version
+	 * and add #defines selecting optional code of the sources
+	 */
 	Shader(
 		const char* vertexSource,
 		const char* fragmentSource,
 		const char* tessControlShaderSource = nullptr,
-		const char* tessEvaluationShaderSource = nullptr);
+		const char* tessEvaluationShaderSource = nullptr,
+		const char* preamble = nullptr,
+		ShaderBuild build = ShaderBuild::Blocking);
+
+	/*
+	 * Compute program, needs GL 4.3
+	 */
+	explicit Shader(const char* computeSource);
+	Shader(const char* computeSource, const std::string& preamble);
+	~Shader();
+
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	/*
+	 * Exchanges the programs (and their uniform tables) of two shaders, e.g. to put a
+	 * rebuilt program in place of the one every user refers to
+	 */
+	void swap(Shader& other);
 
 	GLuint getId() const;
+
+	// Key of the binary in the ProgramCache
+	std::uint64_t getCacheKey() const;
+
+	// Waits for an async build that is not done yet
 	void useProgram();
 
-	void setUniformBool(const std::string& name, GLboolean value) const;
-	void setUniformInt(const std::string& name, GLint value) const;
-	void setUniformFloat(const std::string& name, GLfloat value) const;
+	/*
+	 * Never blocks with KHR_parallel_shader_compile, without it the first call waits for the
+	 * build. Stays false for a program that failed to build, the log is printed once.
+	 * Uniforms are found once the program is ready
+	 */
+	bool isReady();
+
+	// The build is done and failed, the error was printed
+	bool hasFailed() const;
+
+	/*
+	 * Reflected once at link time, array uniforms are found by their plain name
+	 */
+	UniformHandle getUniform(std::string_view name) const;
+
+	void setUniformBool(UniformHandle uniform, GLboolean value) const;
+	void setUniformInt(UniformHandle uniform, GLint value) const;
+	void setUniformFloat(UniformHandle uniform, GLfloat value) const;
+	void setUniformVec2(UniformHandle uniform, const glm::vec2& value) const;
+	void setUniformVec3(UniformHandle uniform, const glm::vec3& value) const;
+	void setUniformVec4Array(UniformHandle uniform, const glm::vec4* values, GLsizei count) const;
+	void setUniformMat4(UniformHandle uniform, const glm::mat4& value) const;
+
+	// One time setup, the name goes through the same table
+	void setUniformBool(std::string_view name, GLboolean value) const;
+	void setUniformInt(std::string_view name, GLint value) const;
+	void setUniformFloat(std::string_view name, GLfloat value) const;
 
 private:
+	enum class ShaderState
+	{
+		Building,
+		Ready,
+		Failed
+	};
+
 	GLuint m_Id;
+	ShaderState m_State;
+	std::map<std::string, UniformHandle, std::less<>> m_Uniforms;
 
-	GLuint compileShader(GLenum shaderType, const GLchar* const* shaderSourceCode) const;
+	// Stages of a build in flight and the binary cache key it is stored under
+	std::vector<std::pair<GLenum, GLuint>> m_PendingShaders;
+	std::uint64_t m_CacheKey;
+
+	void build(const std::vector<ShaderStage>& stages, ShaderBuild build);
+	void finishBuild();
+	GLuint compileShader(GLenum shaderType, const std::string& shaderSourceCode) const;
 	GLvoid checkCompileErros(GLuint shader, const std::string name) const;
+	bool checkLinkStatus() const;
+
+	// Uniform table and block bindings of the linked program
+	void reflectProgram();
+	bool checkUniformType(UniformHandle uniform, GLenum type) const;
 };
@@ -0,0 +1,163 @@
+#include "shader_files.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Saving a file is picked up within this delay
+static const std::chrono::milliseconds POLL_INTERVAL(250);
+
+static const char* INCLUDE_DIRECTIVE = "#include";
+
+ShaderFiles::ShaderFiles(std::string directory, std::vector<std::string> stageFiles)
+	: m_Directory(std::move(directory))
+	, m_StageFiles(std::move(stageFiles))
+	, m_Loaded(false)
+	, m_Stop(false)
+	, m_Changed(false)
+{
+	this->m_Loaded = this->readStages(this->m_Sources, this->m_Watched);
+	this->m_Thread = std::thread(&ShaderFiles::watch, this);
+}
+
+ShaderFiles::~ShaderFiles()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		this->m_Stop = true;
+	}
+	this->m_Wake.notify_one();
+	this->m_Thread.join();
+}
+
+bool ShaderFiles::isLoaded() const
+{
+	return this->m_Loaded;
+}
+
+const std::vector<std::string>& ShaderFiles::getSources() const
+{
+	return this->m_Sources;
+}
+
+bool ShaderFiles::takeChanged(std::vector<std::string>& sources)
+{
+	std::lock_guard<std::mutex> lock(this->m_Mutex);
+	if (!this->m_Changed)
+	{
+		return false;
+	}
+
+	sources.swap(this->m_ChangedSources);
+	this->m_Changed = false;
+	return true;
+}
+
+bool ShaderFiles::readStages(std::vector<std::string>& sources, std::vector<WatchedFile>& watched) const
+{
+	sources.clear();
+	watched.clear();
+
+	bool success = true;
+	for (const std::string& stageFile : this->m_StageFiles)
+	{
+		std::string source;
+		std::set<std::string> included;
+		success = this->readFile(stageFile, source, included, watched) && success;
+		sources.push_back(std::move(source));
+	}
+	return success;
+}
+
+bool ShaderFiles::readFile(const std::string& name, std::string& source, std::set<std::string>& included, std::vector<WatchedFile>& watched) const
+{
+	// Also stops include cycles
+	if (!included.insert(name).second)
+	{
+		return true;
+	}
+
+	std::filesystem::path path = std::filesystem::path(this->m_Directory) / name;
+
+	// A missing file is still watched, it is read again once it shows up
+	std::error_code error;
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+	watched.push_back({ path, error ? std::filesystem::file_time_type::min() : time });
+
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "ERROR::SHADER::FILE_NOT_READ " << path.string() << std::endl;
+		return false;
+	}
+
+	// Driver errors name the file by the source string number of its #line, the order in
+	// which the stage included it (0 is the stage file, whose first line is the #version)
+	std::size_t fileNumber = included.size() - 1;
+	if (fileNumber > 0)
+	{
+		source += "#line 1 " + std::to_string(fileNumber) + " // " + name + "\n";
+	}
+
+	bool success = true;
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		std::size_t start = line.find_first_not_of(" \t");
+		if (start != std::string::npos && line.compare(start, std::strlen(INCLUDE_DIRECTIVE), INCLUDE_DIRECTIVE) == 0)
+		{
+			std::size_t first = line.find('"', start);
+			std::size_t last = first != std::string::npos ? line.find('"', first + 1) : std::string::npos;
+			if (last == std::string::npos)
+			{
+				std::cout << "ERROR::SHADER::BAD_INCLUDE " << path.string() << ": " << line << std::endl;
+				success = false;
+				continue;
+			}
+
+			success = this->readFile(line.substr(first + 1, last - first - 1), source, included, watched) && success;
+			source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileNumber) + "\n";
+			continue;
+		}
+
+		source += line;
+		source += '\n';
+	}
+
+	return success;
+}
+
+void ShaderFiles::watch()
+{
+	std::unique_lock<std::mutex> lock(this->m_Mutex);
+	while (!this->m_Wake.wait_for(lock, POLL_INTERVAL, [this] { return this->m_Stop; }))
+	{
+		lock.unlock();
+
+		bool changed = false;
+		for (const WatchedFile& watchedFile : this->m_Watched)
+		{
+			std::error_code error;
+			std::filesystem::file_time_type time = std::filesystem::last_write_time(watchedFile.path, error);
+			if ((error ? std::filesystem::file_time_type::min() : time) != watchedFile.time)
+			{
+				changed = true;
+				break;
+			}
+		}
+
+		std::vector<std::string> sources;
+		bool success = changed && this->readStages(sources, this->m_Watched);
+
+		lock.lock();
+		if (success)
+		{
+			this->m_ChangedSources = std::move(sources);
+			this->m_Changed = true;
+		}
+	}
+}
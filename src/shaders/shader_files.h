@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Stage sources read from files. An #include "name" line is replaced by the named file
+ * of the same directory, once per stage, between #line directives so driver errors give
+ * the line in the file (source string n is the nth file the stage included). A background
+ * thread polls the files and their includes and reads them again when one changes,
+ * takeChanged() hands the new sources to the render thread. Only the file reads leave the
+ * render thread, the programs are built on the GL context and without
+ * KHR/ARB_parallel_shader_compile the rebuild stalls a frame for the compile and link
+ */
+class ShaderFiles
+{
+public:
+	ShaderFiles(std::string directory, std::vector<std::string> stageFiles);
+	~ShaderFiles();
+
+	ShaderFiles(const ShaderFiles&) = delete;
+	ShaderFiles& operator=(const ShaderFiles&) = delete;
+
+	/*
+	 * False when a file could not be read at construction, the error is printed
+	 */
+	bool isLoaded() const;
+
+	// Sources read at construction, in the order of stageFiles
+	const std::vector<std::string>& getSources() const;
+
+	/*
+	 * True once per change of the files, sources then holds the new stage sources.
+	 * Edits that leave a file unreadable are reported and skipped
+	 */
+	bool takeChanged(std::vector<std::string>& sources);
+
+private:
+	struct WatchedFile
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type time;
+	};
+
+	std::string m_Directory;
+	std::vector<std::string> m_StageFiles;
+	std::vector<std::string> m_Sources;
+	bool m_Loaded;
+
+	// Only touched by the watch thread once it runs
+	std::vector<WatchedFile> m_Watched;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	bool m_Stop;
+	bool m_Changed;
+	std::vector<std::string> m_ChangedSources;
+	std::thread m_Thread;
+
+	bool readStages(std::vector<std::string>& sources, std::vector<WatchedFile>& watched) const;
+	bool readFile(const std::string& name, std::string& source, std::set<std::string>& included, std::vector<WatchedFile>& watched) const;
+	void watch();
+};
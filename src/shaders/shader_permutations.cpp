@@ -0,0 +1,177 @@
+#include "shader_permutations.h"
+
+#include "program_cache.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+ShaderDefines& ShaderDefines::define(const std::string& name)
+{
+	this->m_Values[name] = "";
+	return *this;
+}
+
+ShaderDefines& ShaderDefines::define(const std::string& name, int value)
+{
+	this->m_Values[name] = std::to_string(value);
+	return *this;
+}
+
+ShaderDefines& ShaderDefines::define(const std::string& name, float value)
+{
+	std::ostringstream text;
+	text << std::setprecision(9) << value;
+
+	// A GLSL float literal, "64" would be an int
+	std::string literal = text.str();
+	if (literal.find_first_of(".en") == std::string::npos)
+	{
+		literal += ".0";
+	}
+
+	this->m_Values[name] = literal;
+	return *this;
+}
+
+std::string ShaderDefines::getLines() const
+{
+	std::string lines;
+	for (const auto& value : this->m_Values)
+	{
+		lines += "#define " + value.first;
+		if (!value.second.empty())
+		{
+			lines += " " + value.second;
+		}
+		lines += "\n";
+	}
+	return lines;
+}
+
+ShaderPermutations::ShaderPermutations(std::string version, std::vector<std::string> sources)
+	: m_Version(std::move(version))
+	, m_Sources(std::move(sources))
+	, m_Compute(false)
+	, m_Reloading(false)
+{
+}
+
+ShaderPermutations::ShaderPermutations(std::string version, std::string computeSource)
+	: m_Version(std::move(version))
+	, m_Sources { std::move(computeSource) }
+	, m_Compute(true)
+	, m_Reloading(false)
+{
+}
+
+Shader& ShaderPermutations::get(const ShaderDefines& defines, ShaderBuild build)
+{
+	std::string preamble = this->m_Version + "\n" + defines.getLines();
+
+	auto variant = this->m_Variants.find(preamble);
+	if (variant != this->m_Variants.end())
+	{
+		return *variant->second;
+	}
+
+	// A variant first asked for during a reload switches with the others
+	if (this->m_Reloading)
+	{
+		this->m_Pending[preamble] = this->build(this->m_PendingSources, preamble, ShaderBuild::Async);
+	}
+
+	std::unique_ptr<Shader> shader = this->build(this->m_Sources, preamble, build);
+	Shader& result = *shader;
+	this->m_Variants.emplace(std::move(preamble), std::move(shader));
+	return result;
+}
+
+void ShaderPermutations::reload(std::vector<std::string> sources)
+{
+	// A reload still in flight is dropped, its sources are already out of date
+	this->m_Pending.clear();
+	this->m_PendingSources = std::move(sources);
+	this->m_Reloading = true;
+
+	for (const auto& variant : this->m_Variants)
+	{
+		this->m_Pending[variant.first] = this->build(this->m_PendingSources, variant.first, ShaderBuild::Async);
+	}
+}
+
+bool ShaderPermutations::update()
+{
+	if (!this->m_Reloading)
+	{
+		return false;
+	}
+
+	bool building = false;
+	bool failed = false;
+	for (const auto& pending : this->m_Pending)
+	{
+		if (pending.second->isReady())
+		{
+			continue;
+		}
+		if (pending.second->hasFailed())
+		{
+			failed = true;
+		}
+		else
+		{
+			building = true;
+		}
+	}
+
+	if (failed)
+	{
+		std::cout << "ERROR::SHADER::RELOAD_FAILED, the previous programs stay in use" << std::endl;
+		this->m_Pending.clear();
+		this->m_Reloading = false;
+		return false;
+	}
+	if (building)
+	{
+		return false;
+	}
+
+	// Swapped in place, the references handed out by get() now use the new programs.
+	// The binaries of the replaced programs are deleted, unless the reload gave the same sources
+	ProgramCache& cache = ProgramCache::get();
+	for (auto& pending : this->m_Pending)
+	{
+		Shader& variant = *this->m_Variants[pending.first];
+		variant.swap(*pending.second);
+		if (pending.second->getCacheKey() != variant.getCacheKey())
+		{
+			cache.remove(pending.second->getCacheKey());
+		}
+	}
+	this->m_Pending.clear();
+	this->m_Sources = std::move(this->m_PendingSources);
+	this->m_Reloading = false;
+	return true;
+}
+
+std::size_t ShaderPermutations::getVariantCount() const
+{
+	return this->m_Variants.size();
+}
+
+std::unique_ptr<Shader> ShaderPermutations::build(const std::vector<std::string>& sources, const std::string& preamble, ShaderBuild build) const
+{
+	if (this->m_Compute)
+	{
+		return std::make_unique<Shader>(sources[0].c_str(), preamble);
+	}
+
+	// Missing or empty tessellation sources leave the stage out
+	auto getTessSource = [&sources](std::size_t stage) -> const char*
+	{
+		return stage < sources.size() && !sources[stage].empty() ? sources[stage].c_str() : nullptr;
+	};
+
+	return std::make_unique<Shader>(sources[0].c_str(), sources[1].c_str(), getTessSource(2), getTessSource(3), preamble.c_str(), build);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+
+/*
+ * #defines selecting a variant of a program. Constants given here are folded by the
+ * compiler instead of read from uniforms, features left out are not compiled at all
+ */
+class ShaderDefines
+{
+public:
+	ShaderDefines& define(const std::string& name);
+	ShaderDefines& define(const std::string& name, int value);
+	ShaderDefines& define(const std::string& name, float value);
+
+	/*
+	 * One #define line per entry, sorted by name, so the same set always gives the same text
+	 */
+	std::string getLines() const;
+
+private:
+	std::map<std::string, std::string> m_Values;
+};
+
+/*
+ * Variants of one set of stage sources. A variant is built on its first get() and kept
+ * under its preamble (#version line and #defines), later calls return the same program.
+ * The sources give defaults (#ifndef) for the values they expect
+ */
+class ShaderPermutations
+{
+public:
+	/*
+	 * version is the first line of every variant, e.g. "#version 460 core". The sources are
+	 * vertex, fragment and optionally tessellation control and evaluation (empty if unused)
+	 */
+	ShaderPermutations(std::string version, std::vector<std::string> sources);
+
+	/*
+	 * Compute variants, reload() then takes the single compute source
+	 */
+	ShaderPermutations(std::string version, std::string computeSource);
+
+	ShaderPermutations(const ShaderPermutations&) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+	/*
+	 * The build mode only applies to the first call of a variant, see Shader::isReady()
+	 */
+	Shader& get(const ShaderDefines& defines, ShaderBuild build = ShaderBuild::Blocking);
+
+	/*
+	 * New sources for every variant, built in the background. The variants switch to them
+	 * together once all of them link, a failed build keeps the current programs. Without
+	 * parallel shader compile the first poll in update() waits for the build
+	 */
+	void reload(std::vector<std::string> sources);
+
+	/*
+	 * Polls a reload in flight. True on the call the variants switch to the new programs,
+	 * the Shader references stay valid but their uniforms must be set up again
+	 */
+	bool update();
+
+	std::size_t getVariantCount() const;
+
+private:
+	std::string m_Version;
+	std::vector<std::string> m_Sources;
+	bool m_Compute;
+
+	std::map<std::string, std::unique_ptr<Shader>> m_Variants;
+
+	// Variants built from the sources of a reload
+	std::vector<std::string> m_PendingSources;
+	std::map<std::string, std::unique_ptr<Shader>> m_Pending;
+	bool m_Reloading;
+
+	std::unique_ptr<Shader> build(const std::vector<std::string>& sources, const std::string& preamble, ShaderBuild build) const;
+};
@@ -0,0 +1,341 @@
+#include "frustum_culler.h"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// Gribb/Hartmann plane extraction, glm is column major so rows are m[0][i]..m[3][i]
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	this->planes[0] = row3 + row0;
+	this->planes[1] = row3 - row0;
+	this->planes[2] = row3 + row1;
+	this->planes[3] = row3 - row1;
+	this->planes[4] = row3 + row2;
+	this->planes[5] = row3 - row2;
+
+	for (glm::vec4& plane : this->planes)
+	{
+		float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		plane /= length;
+	}
+}
+
+FrustumCuller::FrustumCuller()
+	: m_Stats { 0, 0, 0, 0, 0.0f }
+{
+}
+
+void FrustumCuller::cull(const PatchQuadtree& quadtree, const PatchBounds& bounds, const Frustum& frustum, const glm::vec3& eye,
+	std::vector<unsigned int>& visible)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	visible.clear();
+	this->m_Stats.tested = 0;
+	this->m_Stats.backfacing = 0;
+	this->m_Stats.nodesVisited = 0;
+
+	if (this->m_LastRejectingPlane.size() != quadtree.getNodeCount())
+	{
+		this->m_LastRejectingPlane.assign(quadtree.getNodeCount(), -1);
+	}
+
+	if (quadtree.getNodeCount() > 0)
+	{
+		this->cullNode(quadtree, 0, bounds, frustum, eye, 0x3F, visible);
+	}
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_Stats.visible = static_cast<unsigned int>(visible.size());
+	this->m_Stats.time = elapsed.count();
+}
+
+const CullStats& FrustumCuller::getStats() const
+{
+	return this->m_Stats;
+}
+
+void FrustumCuller::cullNode(const PatchQuadtree& quadtree, unsigned int index, const PatchBounds& bounds, const Frustum& frustum,
+	const glm::vec3& eye, unsigned int planeMask, std::vector<unsigned int>& visible)
+{
+	const QuadtreeNode& node = quadtree.getNode(index);
+	this->m_Stats.nodesVisited++;
+
+	// Distance of the AABB corner furthest along (positive) or against (negative) the plane normal
+	auto positiveDistance = [&node](const glm::vec4& plane) {
+		return plane.w
+			+ plane.x * (plane.x > 0.0f ? node.maxX : node.minX)
+			+ plane.y * (plane.y > 0.0f ? node.maxY : node.minY)
+			+ plane.z * (plane.z > 0.0f ? node.maxZ : node.minZ);
+	};
+	auto negativeDistance = [&node](const glm::vec4& plane) {
+		return plane.w
+			+ plane.x * (plane.x > 0.0f ? node.minX : node.maxX)
+			+ plane.y * (plane.y > 0.0f ? node.minY : node.maxY)
+			+ plane.z * (plane.z > 0.0f ? node.minZ : node.maxZ);
+	};
+
+	// Plane coherency, the plane that rejected the node last frame most likely still does
+	int lastPlane = this->m_LastRejectingPlane[index];
+	if (lastPlane >= 0 && (planeMask & (1u << lastPlane)) != 0 && positiveDistance(frustum.planes[lastPlane]) < 0.0f)
+	{
+		return;
+	}
+
+	for (int p = 0; p < 6; p++)
+	{
+		if ((planeMask & (1u << p)) == 0)
+		{
+			continue;
+		}
+
+		if (positiveDistance(frustum.planes[p]) < 0.0f)
+		{
+			this->m_LastRejectingPlane[index] = p;
+			return;
+		}
+
+		if (negativeDistance(frustum.planes[p]) >= 0.0f)
+		{
+			planeMask &= ~(1u << p);
+		}
+	}
+
+	this->m_LastRejectingPlane[index] = -1;
+
+	if (planeMask == 0 || node.isLeaf())
+	{
+		// With no plane left only the normal cones are tested
+		this->m_Stats.tested += node.count;
+		this->m_Stats.backfacing += cullPatchRange(bounds, frustum, planeMask, eye, node.first, node.first + node.count, visible);
+	}
+	else
+	{
+		for (int child : node.children)
+		{
+			if (child >= 0)
+			{
+				this->cullNode(quadtree, child, bounds, frustum, eye, planeMask, visible);
+			}
+		}
+	}
+}
+
+/*
+ * Normal cone test. From the eye the patch bounding sphere (center c, radius r) spans
+ * a cone of half angle beta = asin(r / |c - eye|); every face looks away from the eye
+ * when angle(axis, c - eye) + alpha + beta < 90 degrees, alpha being the normal cone
+ * half angle. With t = sqrt(|c - eye|^2 - r^2) that is
+ *   dot(axis, c - eye) > sin(alpha) * t + cos(alpha) * r and cos(alpha) * t > sin(alpha) * r
+ * An eye inside the sphere gives a NaN t and fails both comparisons
+ */
+static bool isBackFacing(const PatchBounds& bounds, const glm::vec3& eye, unsigned int i)
+{
+	float extentX = (bounds.maxX[i] - bounds.minX[i]) * 0.5f;
+	float extentY = (bounds.maxY[i] - bounds.minY[i]) * 0.5f;
+	float extentZ = (bounds.maxZ[i] - bounds.minZ[i]) * 0.5f;
+	float toCenterX = bounds.minX[i] + extentX - eye.x;
+	float toCenterY = bounds.minY[i] + extentY - eye.y;
+	float toCenterZ = bounds.minZ[i] + extentZ - eye.z;
+
+	float radius2 = extentX * extentX + extentY * extentY + extentZ * extentZ;
+	float distance2 = toCenterX * toCenterX + toCenterY * toCenterY + toCenterZ * toCenterZ;
+	if (distance2 <= radius2)
+	{
+		return false;
+	}
+
+	float tangent = std::sqrt(distance2 - radius2);
+	float radius = std::sqrt(radius2);
+	float alongAxis = bounds.coneX[i] * toCenterX + bounds.coneY[i] * toCenterY + bounds.coneZ[i] * toCenterZ;
+
+	return alongAxis > bounds.coneSin[i] * tangent + bounds.coneCos[i] * radius
+		&& bounds.coneCos[i] * tangent > bounds.coneSin[i] * radius;
+}
+
+#if defined(FRUSTUM_CULLER_AVX)
+static __m256 isBackFacing8(const PatchBounds& bounds, const glm::vec3& eye, unsigned int i)
+{
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 minX = _mm256_loadu_ps(bounds.minX.data() + i);
+	__m256 minY = _mm256_loadu_ps(bounds.minY.data() + i);
+	__m256 minZ = _mm256_loadu_ps(bounds.minZ.data() + i);
+	__m256 extentX = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds.maxX.data() + i), minX), half);
+	__m256 extentY = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds.maxY.data() + i), minY), half);
+	__m256 extentZ = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds.maxZ.data() + i), minZ), half);
+	__m256 toCenterX = _mm256_sub_ps(_mm256_add_ps(minX, extentX), _mm256_set1_ps(eye.x));
+	__m256 toCenterY = _mm256_sub_ps(_mm256_add_ps(minY, extentY), _mm256_set1_ps(eye.y));
+	__m256 toCenterZ = _mm256_sub_ps(_mm256_add_ps(minZ, extentZ), _mm256_set1_ps(eye.z));
+
+	__m256 radius2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(extentX, extentX), _mm256_mul_ps(extentY, extentY)), _mm256_mul_ps(extentZ, extentZ));
+	__m256 distance2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toCenterX, toCenterX), _mm256_mul_ps(toCenterY, toCenterY)), _mm256_mul_ps(toCenterZ, toCenterZ));
+	__m256 tangent = _mm256_sqrt_ps(_mm256_sub_ps(distance2, radius2));
+	__m256 radius = _mm256_sqrt_ps(radius2);
+
+	__m256 coneSin = _mm256_loadu_ps(bounds.coneSin.data() + i);
+	__m256 coneCos = _mm256_loadu_ps(bounds.coneCos.data() + i);
+	__m256 alongAxis = _mm256_add_ps(_mm256_add_ps(
+		_mm256_mul_ps(_mm256_loadu_ps(bounds.coneX.data() + i), toCenterX),
+		_mm256_mul_ps(_mm256_loadu_ps(bounds.coneY.data() + i), toCenterY)),
+		_mm256_mul_ps(_mm256_loadu_ps(bounds.coneZ.data() + i), toCenterZ));
+
+	__m256 facing = _mm256_cmp_ps(alongAxis, _mm256_add_ps(_mm256_mul_ps(coneSin, tangent), _mm256_mul_ps(coneCos, radius)), _CMP_GT_OQ);
+	__m256 narrow = _mm256_cmp_ps(_mm256_mul_ps(coneCos, tangent), _mm256_mul_ps(coneSin, radius), _CMP_GT_OQ);
+	return _mm256_and_ps(facing, narrow);
+}
+#elif defined(FRUSTUM_CULLER_SSE)
+static __m128 isBackFacing4(const PatchBounds& bounds, const glm::vec3& eye, unsigned int i)
+{
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 minX = _mm_loadu_ps(bounds.minX.data() + i);
+	__m128 minY = _mm_loadu_ps(bounds.minY.data() + i);
+	__m128 minZ = _mm_loadu_ps(bounds.minZ.data() + i);
+	__m128 extentX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds.maxX.data() + i), minX), half);
+	__m128 extentY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds.maxY.data() + i), minY), half);
+	__m128 extentZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds.maxZ.data() + i), minZ), half);
+	__m128 toCenterX = _mm_sub_ps(_mm_add_ps(minX, extentX), _mm_set1_ps(eye.x));
+	__m128 toCenterY = _mm_sub_ps(_mm_add_ps(minY, extentY), _mm_set1_ps(eye.y));
+	__m128 toCenterZ = _mm_sub_ps(_mm_add_ps(minZ, extentZ), _mm_set1_ps(eye.z));
+
+	__m128 radius2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, extentX), _mm_mul_ps(extentY, extentY)), _mm_mul_ps(extentZ, extentZ));
+	__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toCenterX, toCenterX), _mm_mul_ps(toCenterY, toCenterY)), _mm_mul_ps(toCenterZ, toCenterZ));
+	__m128 tangent = _mm_sqrt_ps(_mm_sub_ps(distance2, radius2));
+	__m128 radius = _mm_sqrt_ps(radius2);
+
+	__m128 coneSin = _mm_loadu_ps(bounds.coneSin.data() + i);
+	__m128 coneCos = _mm_loadu_ps(bounds.coneCos.data() + i);
+	__m128 alongAxis = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(_mm_loadu_ps(bounds.coneX.data() + i), toCenterX),
+		_mm_mul_ps(_mm_loadu_ps(bounds.coneY.data() + i), toCenterY)),
+		_mm_mul_ps(_mm_loadu_ps(bounds.coneZ.data() + i), toCenterZ));
+
+	__m128 facing = _mm_cmpgt_ps(alongAxis, _mm_add_ps(_mm_mul_ps(coneSin, tangent), _mm_mul_ps(coneCos, radius)));
+	__m128 narrow = _mm_cmpgt_ps(_mm_mul_ps(coneCos, tangent), _mm_mul_ps(coneSin, radius));
+	return _mm_and_ps(facing, narrow);
+}
+#endif
+
+unsigned int cullPatchRange(const PatchBounds& bounds, const Frustum& frustum, unsigned int planeMask, const glm::vec3& eye,
+	unsigned int first, unsigned int last, std::vector<unsigned int>& visible)
+{
+	/*
+	 * For every plane only the AABB corner furthest along the plane normal (the
+	 * "positive vertex") needs testing, picking it per plane keeps the kernel branchless
+	 */
+	const float* px[6];
+	const float* py[6];
+	const float* pz[6];
+	glm::vec4 planes[6];
+	int planeCount = 0;
+
+	for (int p = 0; p < 6; p++)
+	{
+		if ((planeMask & (1u << p)) == 0)
+		{
+			continue;
+		}
+
+		const glm::vec4& plane = frustum.planes[p];
+		px[planeCount] = plane.x > 0.0f ? bounds.maxX.data() : bounds.minX.data();
+		py[planeCount] = plane.y > 0.0f ? bounds.maxY.data() : bounds.minY.data();
+		pz[planeCount] = plane.z > 0.0f ? bounds.maxZ.data() : bounds.minZ.data();
+		planes[planeCount] = plane;
+		planeCount++;
+	}
+
+	unsigned int i = first;
+	unsigned int backfacing = 0;
+
+#if defined(FRUSTUM_CULLER_AVX)
+	for (; i + 8 <= last; i += 8)
+	{
+		__m256 outside = _mm256_setzero_ps();
+		for (int p = 0; p < planeCount; p++)
+		{
+			__m256 distance = _mm256_set1_ps(planes[p].w);
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(planes[p].x), _mm256_loadu_ps(px[p] + i)));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(planes[p].y), _mm256_loadu_ps(py[p] + i)));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(planes[p].z), _mm256_loadu_ps(pz[p] + i)));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		int backMask = _mm256_movemask_ps(_mm256_andnot_ps(outside, isBackFacing8(bounds, eye, i)));
+		backfacing += std::popcount(static_cast<unsigned int>(backMask));
+
+		int mask = _mm256_movemask_ps(outside) | backMask;
+		for (int lane = 0; lane < 8; lane++)
+		{
+			if ((mask & (1 << lane)) == 0)
+			{
+				visible.push_back(i + lane);
+			}
+		}
+	}
+#elif defined(FRUSTUM_CULLER_SSE)
+	for (; i + 4 <= last; i += 4)
+	{
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < planeCount; p++)
+		{
+			__m128 distance = _mm_set1_ps(planes[p].w);
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p].x), _mm_loadu_ps(px[p] + i)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p].y), _mm_loadu_ps(py[p] + i)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p].z), _mm_loadu_ps(pz[p] + i)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+		}
+
+		int backMask = _mm_movemask_ps(_mm_andnot_ps(outside, isBackFacing4(bounds, eye, i)));
+		backfacing += std::popcount(static_cast<unsigned int>(backMask));
+
+		int mask = _mm_movemask_ps(outside) | backMask;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((mask & (1 << lane)) == 0)
+			{
+				visible.push_back(i + lane);
+			}
+		}
+	}
+#endif
+
+	// Scalar tail (and fallback for targets without SSE2)
+	for (; i < last; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < planeCount && inside; p++)
+		{
+			float distance = planes[p].w + planes[p].x * px[p][i] + planes[p].y * py[p][i] + planes[p].z * pz[p][i];
+			inside = distance >= 0.0f;
+		}
+
+		if (!inside)
+		{
+			continue;
+		}
+
+		if (isBackFacing(bounds, eye, i))
+		{
+			backfacing++;
+		}
+		else
+		{
+			visible.push_back(i);
+		}
+	}
+
+	return backfacing;
+}
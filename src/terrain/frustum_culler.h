@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+
+#include "patch_bounds.h"
+#include "patch_quadtree.h"
+
+/*
+ * The six planes of a view-projection matrix (left, right, bottom, top, near, far),
+ * normalized and pointing inside the frustum
+ */
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	explicit Frustum(const glm::mat4& viewProjection);
+};
+
+/*
+ * Counters of the last cull() call
+ */
+struct CullStats
+{
+	unsigned int tested;
+	unsigned int visible;
+	unsigned int backfacing;
+	unsigned int nodesVisited;
+	float time; // microseconds
+};
+
+/*
+ * Tests the patch AABBs against the frustum with an SSE/AVX kernel and outputs the
+ * compacted, ascending list of visible patch indices. The same kernel rejects the
+ * patches whose normal cone faces away from the eye (far side of steep ridges)
+ */
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	/*
+	 * Walks the quadtree from the root. Each node carries the mask of the planes it still intersects,
+	 * fully inside subtrees are emitted without tests and the plane that rejected a
+	 * node is tried first on the next frame, so the cost follows the visible set.
+	 * Patches of fully inside subtrees still go through the normal cone test
+	 */
+	void cull(const PatchQuadtree& quadtree, const PatchBounds& bounds, const Frustum& frustum, const glm::vec3& eye,
+		std::vector<unsigned int>& visible);
+
+	const CullStats& getStats() const;
+
+private:
+	CullStats m_Stats;
+
+	// Plane that rejected each quadtree node on the last frame, -1 when none
+	std::vector<int> m_LastRejectingPlane;
+
+	void cullNode(const PatchQuadtree& quadtree, unsigned int index, const PatchBounds& bounds, const Frustum& frustum,
+		const glm::vec3& eye, unsigned int planeMask, std::vector<unsigned int>& visible);
+};
+
+/*
+ * SIMD kernel shared by the culling passes. Tests the patches [first, last) against
+ * the planes selected by planeMask and their normal cones against the eye, appends
+ * the visible ones to visible and returns how many were rejected as back facing only
+ */
+unsigned int cullPatchRange(const PatchBounds& bounds, const Frustum& frustum, unsigned int planeMask, const glm::vec3& eye,
+	unsigned int first, unsigned int last, std::vector<unsigned int>& visible);
@@ -0,0 +1,174 @@
+#include "gpu_culler.h"
+
+#include <vector>
+
+#include "../renderer/gl_state.h"
+
+static const GLuint GROUP_SIZE = 64;
+static const GLenum DEPTH_PYRAMID_UNIT = GL_TEXTURE2;
+
+GpuCuller::GpuCuller(const PatchBounds& bounds, GLsizei indicesPerPatch, std::string cullSource)
+	: m_CullPermutations("#version 430 core", std::move(cullSource))
+	, m_CullPrograms {}
+	, m_DrawDataBuffer(0)
+	, m_PatchCount(bounds.size())
+	, m_IndicesPerPatch(indicesPerPatch)
+{
+	// Matches PatchData in the compute shader: min corner + cone sin, max corner + cone cos, cone axis
+	std::vector<float> patches;
+	patches.reserve(this->m_PatchCount * 12);
+	for (unsigned int i = 0; i < this->m_PatchCount; i++)
+	{
+		patches.insert(patches.end(), {
+			bounds.minX[i], bounds.minY[i], bounds.minZ[i], bounds.coneSin[i],
+			bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i], bounds.coneCos[i],
+			bounds.coneX[i], bounds.coneY[i], bounds.coneZ[i], 0.0f });
+	}
+
+	glGenBuffers(1, &this->m_PatchBuffer);
+	GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_PatchBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, patches.size() * sizeof(float), patches.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &this->m_CommandBuffer);
+	GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_CommandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, this->m_PatchCount * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &this->m_DrawCountBuffer);
+	GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_DrawCountBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+	// Every compacted command draws the single surface, its record is the same for all of them.
+	// Only the DRAW_DATA variant (GL 4.6) reads them
+	if (GLAD_GL_VERSION_4_6)
+	{
+		std::vector<ChunkDrawData> records(this->m_PatchCount, { glm::vec2(0.0f), 1.0f, 0.0f });
+		glGenBuffers(1, &this->m_DrawDataBuffer);
+		GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_DrawDataBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(ChunkDrawData), records.data(), GL_STATIC_DRAW);
+	}
+
+	GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+GpuCuller::~GpuCuller()
+{
+	glDeleteBuffers(1, &this->m_PatchBuffer);
+	glDeleteBuffers(1, &this->m_CommandBuffer);
+	glDeleteBuffers(1, &this->m_DrawCountBuffer);
+	if (this->m_DrawDataBuffer != 0)
+	{
+		glDeleteBuffers(1, &this->m_DrawDataBuffer);
+	}
+}
+
+void GpuCuller::reload(std::string cullSource)
+{
+	this->m_CullPermutations.reload({ std::move(cullSource) });
+}
+
+void GpuCuller::cull(const Frustum& frustum, const DepthPyramid& depthPyramid)
+{
+	// The reloaded programs are swapped into the same Shader objects, only their uniforms move
+	if (this->m_CullPermutations.update())
+	{
+		for (CullProgram& program : this->m_CullPrograms)
+		{
+			if (program.shader != nullptr)
+			{
+				program = this->getCullUniforms(*program.shader);
+			}
+		}
+	}
+
+	GLuint zero = 0;
+	GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_DrawCountBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	// Without glMultiDrawElementsIndirectCount the whole buffer is submitted, the unused tail must draw nothing
+	if (!GLAD_GL_VERSION_4_6)
+	{
+		GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_CommandBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	}
+	GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	GlState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->m_PatchBuffer);
+	GlState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->m_CommandBuffer);
+	GlState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->m_DrawCountBuffer);
+
+	const CullProgram& program = this->getCullProgram(depthPyramid.isValid());
+	program.shader->useProgram();
+	program.shader->setUniformInt(program.patchCount, static_cast<GLint>(this->m_PatchCount));
+	program.shader->setUniformInt(program.indicesPerPatch, this->m_IndicesPerPatch);
+	program.shader->setUniformVec4Array(program.planes, frustum.planes, 6);
+
+	if (depthPyramid.isValid())
+	{
+		program.shader->setUniformInt(program.depthPyramid, DEPTH_PYRAMID_UNIT - GL_TEXTURE0);
+		program.shader->setUniformMat4(program.previousViewProjection, depthPyramid.getViewProjection());
+		GlState::get().bindTexture(DEPTH_PYRAMID_UNIT - GL_TEXTURE0, GL_TEXTURE_2D, depthPyramid.getTexture());
+	}
+
+	glDispatchCompute((this->m_PatchCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+	// The commands and the count are read by the next draw
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+void GpuCuller::draw() const
+{
+	GlState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, this->m_CommandBuffer);
+
+	if (GLAD_GL_VERSION_4_6)
+	{
+		GlState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, this->m_DrawDataBuffer);
+		GlState::get().bindBuffer(GL_PARAMETER_BUFFER, this->m_DrawCountBuffer);
+		glMultiDrawElementsIndirectCount(GL_PATCHES, GL_UNSIGNED_INT, nullptr, 0, static_cast<GLsizei>(this->m_PatchCount), 0);
+		GlState::get().bindBuffer(GL_PARAMETER_BUFFER, 0);
+	}
+	else
+	{
+		glMultiDrawElementsIndirect(GL_PATCHES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(this->m_PatchCount), 0);
+	}
+
+	GlState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+unsigned int GpuCuller::readVisibleCount() const
+{
+	GLuint count = 0;
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	GlState::get().bindBuffer(GL_COPY_READ_BUFFER, this->m_DrawCountBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+	GlState::get().bindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return count;
+}
+
+unsigned int GpuCuller::getPatchCount() const
+{
+	return this->m_PatchCount;
+}
+
+const GpuCuller::CullProgram& GpuCuller::getCullProgram(bool occlusion)
+{
+	CullProgram& program = this->m_CullPrograms[occlusion ? 1 : 0];
+	if (program.shader == nullptr)
+	{
+		ShaderDefines defines;
+		if (occlusion)
+		{
+			defines.define("DEPTH_OCCLUSION");
+		}
+
+		program = this->getCullUniforms(this->m_CullPermutations.get(defines));
+	}
+	return program;
+}
+
+GpuCuller::CullProgram GpuCuller::getCullUniforms(Shader& shader)
+{
+	return { &shader, shader.getUniform("uPatchCount"), shader.getUniform("uIndicesPerPatch"), shader.getUniform("uPlanes"),
+		shader.getUniform("depthPyramid"), shader.getUniform("uPreviousViewProjection") };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+
+#include "glad/glad.h"
+
+#include "../renderer/depth_pyramid.h"
+#include "../shaders/shader_permutations.h"
+#include "frustum_culler.h"
+#include "patch_draw_list.h"
+#include "patch_bounds.h"
+
+/*
+ * GPU driven culling (GL 4.3). A compute shader tests every patch against the frustum,
+ * its normal cone and the depth pyramid of the previous frame, then appends the visible
+ * ones to a compacted DrawElementsIndirectCommand buffer. A single multi draw indirect
+ * consumes it, so the CPU cost does not depend on the patch count.
+ * The occlusion test is one frame late: a patch hidden last frame that becomes visible
+ * now shows up on the next frame
+ */
+class GpuCuller
+{
+public:
+	/*
+	 * cullSource is patch_cull.comp, read through ShaderFiles
+	 */
+	GpuCuller(const PatchBounds& bounds, GLsizei indicesPerPatch, std::string cullSource);
+	~GpuCuller();
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	/*
+	 * New source for the cull programs, the current ones run until it links
+	 */
+	void reload(std::string cullSource);
+
+	/*
+	 * The eye position comes from the Camera uniform block, updated before the call
+	 */
+	void cull(const Frustum& frustum, const DepthPyramid& depthPyramid);
+
+	/*
+	 * Draws the visible patches, the terrain program, VAO and element buffer must be bound
+	 */
+	void draw() const;
+
+	/*
+	 * Waits for the culling pass, only meant for statistics
+	 */
+	unsigned int readVisibleCount() const;
+
+	unsigned int getPatchCount() const;
+
+private:
+	/*
+	 * Variant of the cull program and its uniforms, the occlusion test is compiled in
+	 * (DEPTH_OCCLUSION) only once a depth pyramid exists
+	 */
+	struct CullProgram
+	{
+		Shader* shader;
+		UniformHandle patchCount;
+		UniformHandle indicesPerPatch;
+		UniformHandle planes;
+		UniformHandle depthPyramid;
+		UniformHandle previousViewProjection;
+	};
+
+	ShaderPermutations m_CullPermutations;
+	CullProgram m_CullPrograms[2];
+
+	GLuint m_PatchBuffer;
+	GLuint m_CommandBuffer;
+	GLuint m_DrawCountBuffer;
+	GLuint m_DrawDataBuffer;
+
+	unsigned int m_PatchCount;
+	GLsizei m_IndicesPerPatch;
+
+	// Built on first use
+	const CullProgram& getCullProgram(bool occlusion);
+
+	static CullProgram getCullUniforms(Shader& shader);
+};
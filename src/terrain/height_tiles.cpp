@@ -0,0 +1,195 @@
+#include "height_tiles.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../renderer/gl_state.h"
+
+HeightTileSet::HeightTileSet(int sourceWidth, int sourceHeight, unsigned int tilesX, unsigned int tilesY, unsigned int layerCount)
+	: m_SourceWidth(sourceWidth)
+	, m_SourceHeight(sourceHeight)
+	, m_TilesX(tilesX)
+	, m_TilesY(tilesY)
+	, m_LayerCount(layerCount)
+	, m_TileWidth((sourceWidth + tilesX - 1) / tilesX)
+	, m_TileHeight((sourceHeight + tilesY - 1) / tilesY)
+	, m_Atlas(needsAtlas(layerCount))
+	, m_AtlasColumns(0)
+	, m_TileLayers(tilesX * tilesY, -1)
+{
+	GLsizei textureWidth = this->m_TileWidth + 1;
+	GLsizei textureHeight = this->m_TileHeight + 1;
+
+	// glTexStorage is GL 4.2, the textures stay mutable for 4.1 contexts
+	glGenTextures(1, &this->m_TileTexture);
+	if (this->m_Atlas)
+	{
+		this->m_AtlasColumns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(layerCount))));
+		int atlasRows = (layerCount + this->m_AtlasColumns - 1) / this->m_AtlasColumns;
+
+		GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D, this->m_TileTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, textureWidth * this->m_AtlasColumns, textureHeight * atlasRows, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	else
+	{
+		GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, this->m_TileTexture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// generateMipmaps() allocates the other levels
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, textureWidth, textureHeight, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+
+	glGenTextures(1, &this->m_LayerTexture);
+	GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D, this->m_LayerTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, tilesX, tilesY, 0, GL_RED_INTEGER, GL_INT, this->m_TileLayers.data());
+
+	// Lowest layers first
+	for (unsigned int layer = layerCount; layer > 0; layer--)
+	{
+		this->m_FreeLayers.push_back(layer - 1);
+	}
+}
+
+HeightTileSet::~HeightTileSet()
+{
+	GlState::get().deleteTexture(this->m_TileTexture);
+	GlState::get().deleteTexture(this->m_LayerTexture);
+}
+
+bool HeightTileSet::needsAtlas(unsigned int layerCount)
+{
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	return layerCount > static_cast<unsigned int>(maxLayers);
+}
+
+int HeightTileSet::load(unsigned int tileX, unsigned int tileY, const unsigned char* data, int nrChannels)
+{
+	GLint layer = this->m_TileLayers[tileY * this->m_TilesX + tileX];
+	if (layer < 0)
+	{
+		if (this->m_FreeLayers.empty())
+		{
+			return -1;
+		}
+		layer = static_cast<GLint>(this->m_FreeLayers.back());
+		this->m_FreeLayers.pop_back();
+	}
+
+	/*
+	 * Tile texel (x, y) is source texel (tileX * tileWidth + x, tileY * tileHeight + y),
+	 * clamped to the source edge for the last row and column
+	 */
+	int textureWidth = this->m_TileWidth + 1;
+	int textureHeight = this->m_TileHeight + 1;
+	this->m_Staging.resize(static_cast<std::size_t>(textureWidth) * textureHeight * 4);
+	for (int y = 0; y < textureHeight; y++)
+	{
+		int sourceY = std::min(static_cast<int>(tileY) * this->m_TileHeight + y, this->m_SourceHeight - 1);
+		for (int x = 0; x < textureWidth; x++)
+		{
+			int sourceX = std::min(static_cast<int>(tileX) * this->m_TileWidth + x, this->m_SourceWidth - 1);
+			const unsigned char* texel = data + (static_cast<std::size_t>(sourceY) * this->m_SourceWidth + sourceX) * nrChannels;
+			unsigned char* destination = &this->m_Staging[(static_cast<std::size_t>(y) * textureWidth + x) * 4];
+			for (int c = 0; c < 4; c++)
+			{
+				destination[c] = c < nrChannels ? texel[c] : 255;
+			}
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (this->m_Atlas)
+	{
+		GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D, this->m_TileTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, (layer % this->m_AtlasColumns) * textureWidth, (layer / this->m_AtlasColumns) * textureHeight,
+			textureWidth, textureHeight, GL_RGBA, GL_UNSIGNED_BYTE, this->m_Staging.data());
+	}
+	else
+	{
+		GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, this->m_TileTexture);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, textureWidth, textureHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, this->m_Staging.data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	this->setTileLayer(tileX, tileY, layer);
+	return layer;
+}
+
+void HeightTileSet::unload(unsigned int tileX, unsigned int tileY)
+{
+	GLint layer = this->m_TileLayers[tileY * this->m_TilesX + tileX];
+	if (layer < 0)
+	{
+		return;
+	}
+
+	this->m_FreeLayers.push_back(static_cast<unsigned int>(layer));
+	this->setTileLayer(tileX, tileY, -1);
+}
+
+void HeightTileSet::loadAll(const unsigned char* data, int nrChannels)
+{
+	for (unsigned int tileY = 0; tileY < this->m_TilesY; tileY++)
+	{
+		for (unsigned int tileX = 0; tileX < this->m_TilesX; tileX++)
+		{
+			this->load(tileX, tileY, data, nrChannels);
+		}
+	}
+	this->generateMipmaps();
+}
+
+void HeightTileSet::generateMipmaps()
+{
+	if (!this->m_Atlas)
+	{
+		GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, this->m_TileTexture);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	}
+}
+
+void HeightTileSet::bind(GLuint tilesUnit, GLuint layersUnit) const
+{
+	GlState::get().bindTexture(tilesUnit, this->m_Atlas ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY, this->m_TileTexture);
+	GlState::get().bindTexture(layersUnit, GL_TEXTURE_2D, this->m_LayerTexture);
+}
+
+bool HeightTileSet::isAtlas() const
+{
+	return this->m_Atlas;
+}
+
+int HeightTileSet::getAtlasColumns() const
+{
+	return this->m_AtlasColumns;
+}
+
+glm::vec2 HeightTileSet::getTileTexels() const
+{
+	return glm::vec2(static_cast<float>(this->m_TileWidth), static_cast<float>(this->m_TileHeight));
+}
+
+unsigned int HeightTileSet::getResidentCount() const
+{
+	return this->m_LayerCount - static_cast<unsigned int>(this->m_FreeLayers.size());
+}
+
+void HeightTileSet::setTileLayer(unsigned int tileX, unsigned int tileY, GLint layer)
+{
+	this->m_TileLayers[tileY * this->m_TilesX + tileX] = layer;
+
+	GlState::get().bindTexture(SETUP_TEXTURE_UNIT, GL_TEXTURE_2D, this->m_LayerTexture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, tileX, tileY, 1, 1, GL_RED_INTEGER, GL_INT, &layer);
+}
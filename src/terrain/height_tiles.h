@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/vec2.hpp"
+
+/*
+ * Heightmap split into tilesX * tilesY tiles, each stored in a layer of a GL_TEXTURE_2D_ARRAY,
+ * so every tile is sampled through one binding and the whole terrain stays one draw.
+ * A tile spans tileTexels texels of the source and stores one more on each axis (the first
+ * texel of the next tile), which keeps the filtered heights continuous across tile edges.
+ * The tileLayers texture (R32I) gives the layer of every tile, -1 while it is not resident,
+ * so tiles can be streamed in and out of any free layer.
+ * When the layers exceed GL_MAX_ARRAY_TEXTURE_LAYERS the tiles go to cells of a 2D atlas
+ * instead, sampled by the HEIGHT_ATLAS shader variant; the atlas has no mips since coarser
+ * levels would blend neighbouring cells
+ */
+class HeightTileSet
+{
+public:
+	HeightTileSet(int sourceWidth, int sourceHeight, unsigned int tilesX, unsigned int tilesY, unsigned int layerCount);
+	~HeightTileSet();
+
+	HeightTileSet(const HeightTileSet&) = delete;
+	HeightTileSet& operator=(const HeightTileSet&) = delete;
+
+	/*
+	 * Whether layerCount tiles need the atlas, known before the shaders are built
+	 */
+	static bool needsAtlas(unsigned int layerCount);
+
+	/*
+	 * Copies tile (tileX, tileY) of the source image to a free layer and returns it,
+	 * -1 when every layer is taken. Call generateMipmaps() once the batch is loaded
+	 */
+	int load(unsigned int tileX, unsigned int tileY, const unsigned char* data, int nrChannels);
+
+	/*
+	 * Frees the layer of a tile, the tile then samples as not resident (height 0)
+	 */
+	void unload(unsigned int tileX, unsigned int tileY);
+
+	void loadAll(const unsigned char* data, int nrChannels);
+	void generateMipmaps();
+
+	/*
+	 * Binds the tiles and the tile -> layer table to two texture units (0 based)
+	 */
+	void bind(GLuint tilesUnit, GLuint layersUnit) const;
+
+	bool isAtlas() const;
+	int getAtlasColumns() const;
+
+	// Source texels spanned by one tile (uTileTexels)
+	glm::vec2 getTileTexels() const;
+
+	unsigned int getResidentCount() const;
+
+private:
+	int m_SourceWidth;
+	int m_SourceHeight;
+	unsigned int m_TilesX;
+	unsigned int m_TilesY;
+	unsigned int m_LayerCount;
+
+	// Tile span and the size of its texture (one more texel)
+	int m_TileWidth;
+	int m_TileHeight;
+
+	bool m_Atlas;
+	int m_AtlasColumns;
+
+	GLuint m_TileTexture;
+	GLuint m_LayerTexture;
+
+	std::vector<GLint> m_TileLayers;
+	std::vector<unsigned int> m_FreeLayers;
+	std::vector<unsigned char> m_Staging;
+
+	void setTileLayer(unsigned int tileX, unsigned int tileY, GLint layer);
+};
@@ -0,0 +1,170 @@
+#include "horizon_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+static const float PI = 3.14159265358979f;
+
+HorizonCuller::HorizonCuller(unsigned int columns)
+	: m_Columns(columns)
+	, m_Stats { 0, 0, 0.0f }
+	, m_Horizon(columns)
+{
+}
+
+void HorizonCuller::cull(const PatchQuadtree& quadtree, const PatchBounds& bounds, const glm::vec3& cameraPosition, std::vector<unsigned int>& visible)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	unsigned int visibleCount = static_cast<unsigned int>(visible.size());
+	this->m_Stats.tested = visibleCount;
+	this->m_Stats.culled = 0;
+
+	// Nothing is known to lie under the view when the camera is outside the terrain or under it
+	int cameraPatch = quadtree.findPatch(cameraPosition.x, cameraPosition.z, bounds);
+	if (cameraPatch < 0 || cameraPosition.y <= bounds.maxY[cameraPatch])
+	{
+		std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		this->m_Stats.time = elapsed.count();
+		return;
+	}
+
+	std::fill(this->m_Horizon.begin(), this->m_Horizon.end(), std::numeric_limits<float>::lowest());
+
+	// Nearest and furthest horizontal distance from the camera to the patch
+	this->m_NearDistance.resize(visibleCount);
+	this->m_FarDistance.resize(visibleCount);
+	this->m_Order.resize(visibleCount);
+	for (unsigned int k = 0; k < visibleCount; k++)
+	{
+		unsigned int patch = visible[k];
+		float nearX = std::max({ bounds.minX[patch] - cameraPosition.x, 0.0f, cameraPosition.x - bounds.maxX[patch] });
+		float nearZ = std::max({ bounds.minZ[patch] - cameraPosition.z, 0.0f, cameraPosition.z - bounds.maxZ[patch] });
+		float farX = std::max(std::abs(bounds.minX[patch] - cameraPosition.x), std::abs(bounds.maxX[patch] - cameraPosition.x));
+		float farZ = std::max(std::abs(bounds.minZ[patch] - cameraPosition.z), std::abs(bounds.maxZ[patch] - cameraPosition.z));
+
+		this->m_NearDistance[k] = std::sqrt(nearX * nearX + nearZ * nearZ);
+		this->m_FarDistance[k] = std::sqrt(farX * farX + farZ * farZ);
+		this->m_Order[k] = k;
+	}
+	std::sort(this->m_Order.begin(), this->m_Order.end(),
+		[this](unsigned int a, unsigned int b) { return this->m_NearDistance[a] < this->m_NearDistance[b]; });
+
+	this->m_Culled.assign(visibleCount, 0);
+	this->m_PendingUpdates.clear();
+
+	auto laterUpdate = [](const PendingUpdate& a, const PendingUpdate& b) { return a.farDistance > b.farDistance; };
+
+	for (unsigned int k : this->m_Order)
+	{
+		unsigned int patch = visible[k];
+		float nearDistance = this->m_NearDistance[k];
+		float farDistance = this->m_FarDistance[k];
+
+		// Occluders entirely in front of this patch can now raise the horizon
+		while (!this->m_PendingUpdates.empty() && this->m_PendingUpdates.front().farDistance <= nearDistance)
+		{
+			const PendingUpdate& update = this->m_PendingUpdates.front();
+			for (int column = update.firstColumn; column <= update.lastColumn; column++)
+			{
+				float& horizon = this->m_Horizon[column % this->m_Columns];
+				horizon = std::max(horizon, update.elevation);
+			}
+
+			std::pop_heap(this->m_PendingUpdates.begin(), this->m_PendingUpdates.end(), laterUpdate);
+			this->m_PendingUpdates.pop_back();
+		}
+
+		int firstColumn = 0;
+		int lastColumn = 0;
+		if (!this->getColumns(bounds, patch, cameraPosition, firstColumn, lastColumn))
+		{
+			continue;
+		}
+
+		// Highest elevation of the patch top, reached at its nearest point when above the camera
+		float top = bounds.maxY[patch] - cameraPosition.y;
+		float topElevation = top / (top > 0.0f ? nearDistance : farDistance);
+
+		bool hidden = true;
+		for (int column = firstColumn; column <= lastColumn && hidden; column++)
+		{
+			hidden = topElevation <= this->m_Horizon[column % this->m_Columns];
+		}
+
+		if (hidden)
+		{
+			this->m_Culled[k] = 1;
+			this->m_Stats.culled++;
+			continue;
+		}
+
+		/*
+		 * The floor of the patch (its min height) is used as occluder, its lowest elevation
+		 * over the columns it spans. The slices at both ends are only partly covered
+		 */
+		float floor = bounds.minY[patch] - cameraPosition.y;
+		float floorElevation = floor / (floor < 0.0f ? nearDistance : farDistance);
+		if (firstColumn + 1 <= lastColumn - 1)
+		{
+			this->m_PendingUpdates.push_back({ farDistance, firstColumn + 1, lastColumn - 1, floorElevation });
+			std::push_heap(this->m_PendingUpdates.begin(), this->m_PendingUpdates.end(), laterUpdate);
+		}
+	}
+
+	unsigned int kept = 0;
+	for (unsigned int k = 0; k < visibleCount; k++)
+	{
+		if (this->m_Culled[k] == 0)
+		{
+			visible[kept++] = visible[k];
+		}
+	}
+	visible.resize(kept);
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_Stats.time = elapsed.count();
+}
+
+const HorizonStats& HorizonCuller::getStats() const
+{
+	return this->m_Stats;
+}
+
+bool HorizonCuller::getColumns(const PatchBounds& bounds, unsigned int patch, const glm::vec3& cameraPosition, int& firstColumn, int& lastColumn) const
+{
+	if (cameraPosition.x >= bounds.minX[patch] && cameraPosition.x <= bounds.maxX[patch]
+		&& cameraPosition.z >= bounds.minZ[patch] && cameraPosition.z <= bounds.maxZ[patch])
+	{
+		return false;
+	}
+
+	// Seen from outside, the patch spans less than half a turn around the direction to its center
+	float centerX = (bounds.minX[patch] + bounds.maxX[patch]) * 0.5f - cameraPosition.x;
+	float centerZ = (bounds.minZ[patch] + bounds.maxZ[patch]) * 0.5f - cameraPosition.z;
+	float centerAngle = std::atan2(centerZ, centerX);
+
+	float minAngle = 0.0f;
+	float maxAngle = 0.0f;
+	for (int corner = 0; corner < 4; corner++)
+	{
+		float x = ((corner & 1) != 0 ? bounds.maxX[patch] : bounds.minX[patch]) - cameraPosition.x;
+		float z = ((corner & 2) != 0 ? bounds.maxZ[patch] : bounds.minZ[patch]) - cameraPosition.z;
+
+		float angle = std::atan2(z, x) - centerAngle;
+		if (angle > PI) angle -= 2.0f * PI;
+		if (angle < -PI) angle += 2.0f * PI;
+
+		minAngle = std::min(minAngle, angle);
+		maxAngle = std::max(maxAngle, angle);
+	}
+
+	// Column indices may run past m_Columns, callers wrap them
+	float columnsPerRadian = this->m_Columns / (2.0f * PI);
+	firstColumn = static_cast<int>(std::floor((centerAngle + minAngle + PI) * columnsPerRadian)) + this->m_Columns;
+	lastColumn = static_cast<int>(std::floor((centerAngle + maxAngle + PI) * columnsPerRadian)) + this->m_Columns;
+
+	return true;
+}
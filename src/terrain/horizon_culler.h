@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+
+#include "patch_bounds.h"
+#include "patch_quadtree.h"
+
+/*
+ * Counters of the last cull() call
+ */
+struct HorizonStats
+{
+	unsigned int tested;
+	unsigned int culled;
+	float time; // microseconds
+};
+
+/*
+ * Front to back horizon culling. A 1D buffer keeps, per column, the highest elevation
+ * (height over horizontal distance from the camera) already covered by terrain;
+ * patches are processed near to far and those whose top stays below the horizon over
+ * all their columns are rejected.
+ * Columns are azimuth slices around the camera rather than screen columns: they are
+ * vertical planes whatever the pitch, which keeps the test exact for heightfields.
+ * Only used while the camera is above the terrain
+ */
+class HorizonCuller
+{
+public:
+	explicit HorizonCuller(unsigned int columns);
+
+	/*
+	 * Removes the patches hidden below the horizon from visible, keeping the order
+	 */
+	void cull(const PatchQuadtree& quadtree, const PatchBounds& bounds, const glm::vec3& cameraPosition, std::vector<unsigned int>& visible);
+
+	const HorizonStats& getStats() const;
+
+private:
+	/*
+	 * Horizon raise from an occluder, applied only once every patch tested after it
+	 * starts beyond its far distance (patches at similar distances overlap in azimuth)
+	 */
+	struct PendingUpdate
+	{
+		float farDistance;
+		int firstColumn;
+		int lastColumn;
+		float elevation;
+	};
+
+	unsigned int m_Columns;
+	HorizonStats m_Stats;
+
+	std::vector<float> m_Horizon;
+	std::vector<unsigned int> m_Order;
+	std::vector<float> m_NearDistance;
+	std::vector<float> m_FarDistance;
+	std::vector<PendingUpdate> m_PendingUpdates;
+	std::vector<unsigned char> m_Culled;
+
+	// Columns spanned by the patch seen from the camera, false when the camera is above it
+	bool getColumns(const PatchBounds& bounds, unsigned int patch, const glm::vec3& cameraPosition, int& firstColumn, int& lastColumn) const;
+};
@@ -0,0 +1,98 @@
+#include "job_pool.h"
+
+JobPool::JobPool(unsigned int workerCount)
+	: m_Job(nullptr)
+	, m_JobCount(0)
+	, m_NextJob(0)
+	, m_Generation(0)
+	, m_PendingWorkers(0)
+	, m_Stop(false)
+{
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		this->m_Workers.emplace_back(&JobPool::workerLoop, this);
+	}
+}
+
+JobPool::~JobPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		this->m_Stop = true;
+	}
+	this->m_WorkReady.notify_all();
+
+	for (std::thread& worker : this->m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void JobPool::run(unsigned int jobCount, const std::function<void(unsigned int)>& job)
+{
+	if (this->m_Workers.empty() || jobCount <= 1)
+	{
+		for (unsigned int i = 0; i < jobCount; i++)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->m_Mutex);
+		this->m_Job = &job;
+		this->m_JobCount = jobCount;
+		this->m_NextJob = 0;
+		this->m_PendingWorkers = static_cast<unsigned int>(this->m_Workers.size());
+		this->m_Generation++;
+	}
+	this->m_WorkReady.notify_all();
+
+	this->drainJobs();
+
+	std::unique_lock<std::mutex> lock(this->m_Mutex);
+	this->m_WorkDone.wait(lock, [this] { return this->m_PendingWorkers == 0; });
+	this->m_Job = nullptr;
+}
+
+unsigned int JobPool::getThreadCount() const
+{
+	return static_cast<unsigned int>(this->m_Workers.size()) + 1;
+}
+
+void JobPool::workerLoop()
+{
+	unsigned int generation = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(this->m_Mutex);
+			this->m_WorkReady.wait(lock, [this, generation] { return this->m_Stop || this->m_Generation != generation; });
+
+			if (this->m_Stop)
+			{
+				return;
+			}
+			generation = this->m_Generation;
+		}
+
+		this->drainJobs();
+
+		{
+			std::lock_guard<std::mutex> lock(this->m_Mutex);
+			this->m_PendingWorkers--;
+		}
+		this->m_WorkDone.notify_one();
+	}
+}
+
+void JobPool::drainJobs()
+{
+	unsigned int job;
+	while ((job = this->m_NextJob++) < this->m_JobCount)
+	{
+		(*this->m_Job)(job);
+	}
+}
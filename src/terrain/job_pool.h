@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Persistent worker threads for the per-frame CPU passes (culling). run() splits
+ * the work in jobs that are shared between the workers and the calling thread
+ */
+class JobPool
+{
+public:
+	explicit JobPool(unsigned int workerCount);
+	~JobPool();
+
+	JobPool(const JobPool&) = delete;
+	JobPool& operator=(const JobPool&) = delete;
+
+	/*
+	 * Calls job(0) .. job(jobCount - 1) and returns once all of them finished
+	 */
+	void run(unsigned int jobCount, const std::function<void(unsigned int)>& job);
+
+	// Workers plus the calling thread
+	unsigned int getThreadCount() const;
+
+private:
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkReady;
+	std::condition_variable m_WorkDone;
+
+	const std::function<void(unsigned int)>* m_Job;
+	unsigned int m_JobCount;
+	std::atomic<unsigned int> m_NextJob;
+
+	unsigned int m_Generation;
+	unsigned int m_PendingWorkers;
+	bool m_Stop;
+
+	void workerLoop();
+	void drainJobs();
+};
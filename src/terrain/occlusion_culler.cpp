@@ -0,0 +1,464 @@
+#include "occlusion_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "glm/vec4.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE
+#endif
+
+// Number of nearest visible patches rasterized as occluders
+static const unsigned int MAX_OCCLUDERS = 64;
+// Clip w below which geometry is treated as crossing the near plane
+static const float NEAR_W = 0.1f;
+// Rows rasterized per job
+static const unsigned int BAND_HEIGHT = 16;
+// Visible patches tested per job
+static const unsigned int TEST_BATCH = 256;
+
+OccluderMesh computeOccluderMesh(const unsigned char* data, int width, int height, int nrChannels, unsigned int rez,
+	const std::vector<unsigned int>& patchOrder, unsigned int gridSize, float minTessLevel)
+{
+	OccluderMesh mesh;
+	mesh.gridSize = gridSize;
+	mesh.heights.resize(patchOrder.size() * (gridSize + 1) * (gridSize + 1));
+
+	// The TES reads the height from the green channel
+	int channel = nrChannels > 1 ? 1 : 0;
+
+	/*
+	 * The min is taken over one cell around each vertex plus the footprint of the mips
+	 * sampled by the TES, so every point of the adjacent cells renders above the vertex
+	 */
+	int margin = patchBoundsMargin(width, height, rez, minTessLevel);
+	int cellX = static_cast<int>(std::ceil(width / (float)(rez * gridSize))) + margin;
+	int cellY = static_cast<int>(std::ceil(height / (float)(rez * gridSize))) + margin;
+
+	auto getVertexTexel = [rez, gridSize](int size, unsigned int vertex)
+	{
+		return static_cast<int>(size * (vertex / (gridSize + 1) + (vertex % (gridSize + 1)) / (float)gridSize) / rez);
+	};
+
+	// The window is separable: the min along x of every row at the vertex columns, then along y
+	unsigned int columns = (rez - 1) * (gridSize + 1);
+	std::vector<unsigned char> rowMin(static_cast<std::size_t>(columns) * height);
+	for (unsigned int column = 0; column < columns; column++)
+	{
+		int tx = getVertexTexel(width, column);
+		for (int y = 0; y < height; y++)
+		{
+			unsigned char minValue = 255;
+			for (int x = std::max(tx - cellX, 0); x <= std::min(tx + cellX, width - 1); x++)
+			{
+				minValue = std::min(minValue, data[(y * width + x) * nrChannels + channel]);
+			}
+			rowMin[static_cast<std::size_t>(column) * height + y] = minValue;
+		}
+	}
+
+	float* out = mesh.heights.data();
+	for (unsigned int patch : patchOrder)
+	{
+		unsigned int i = patch / (rez - 1);
+		unsigned int j = patch % (rez - 1);
+
+		for (unsigned int a = 0; a <= gridSize; a++)
+		{
+			const unsigned char* column = &rowMin[static_cast<std::size_t>(i * (gridSize + 1) + a) * height];
+			for (unsigned int b = 0; b <= gridSize; b++)
+			{
+				int ty = getVertexTexel(height, j * (gridSize + 1) + b);
+
+				unsigned char minValue = 255;
+				for (int y = std::max(ty - cellY, 0); y <= std::min(ty + cellY, height - 1); y++)
+				{
+					minValue = std::min(minValue, column[y]);
+				}
+
+				*out++ = minValue / 255.0f * TERRAIN_HEIGHT_SCALE + TERRAIN_HEIGHT_OFFSET;
+			}
+		}
+	}
+
+	return mesh;
+}
+
+OcclusionCuller::OcclusionCuller(unsigned int width, unsigned int height, JobPool& jobPool)
+	: m_Width(width)
+	, m_Height(height)
+	, m_JobPool(jobPool)
+	, m_OccluderMesh { 0, {} }
+	, m_Stats { 0, 0, 0, 0.0f }
+	, m_OccluderVersion(0)
+	, m_SelectionTime(0.0f)
+{
+	// Rows are processed 4 pixels at a time
+	this->m_Width = (width + 3) & ~3u;
+
+	unsigned int levelWidth = this->m_Width;
+	unsigned int levelHeight = this->m_Height;
+	while (true)
+	{
+		this->m_LevelWidth.push_back(levelWidth);
+		this->m_LevelHeight.push_back(levelHeight);
+		this->m_HiZ.emplace_back(levelWidth * levelHeight, 1.0f);
+
+		if (levelWidth == 1 && levelHeight == 1)
+		{
+			break;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+void OcclusionCuller::setOccluderMesh(OccluderMesh mesh)
+{
+	this->m_OccluderMesh = std::move(mesh);
+}
+
+void OcclusionCuller::cull(const PatchBounds& bounds, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, std::vector<unsigned int>& visible)
+{
+	this->selectOccluders(bounds, cameraPosition, visible);
+	this->cullSelected(bounds, viewProjection, visible);
+}
+
+void OcclusionCuller::cullSelected(const PatchBounds& bounds, const glm::mat4& viewProjection, std::vector<unsigned int>& visible)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Nothing to test, the occluders are not worth rasterizing
+	if (visible.empty())
+	{
+		this->m_Stats.occluders = 0;
+		this->m_Stats.tested = 0;
+		this->m_Stats.occluded = 0;
+		this->m_Stats.time = this->m_SelectionTime;
+		return;
+	}
+
+	this->setupTriangles(bounds, viewProjection);
+
+	unsigned int bandCount = (this->m_Height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+	this->m_JobPool.run(bandCount, [this](unsigned int band) {
+		this->rasterizeBand(band * BAND_HEIGHT, std::min((band + 1) * BAND_HEIGHT, this->m_Height));
+	});
+
+	this->buildHiZ();
+
+	unsigned int visibleCount = static_cast<unsigned int>(visible.size());
+	this->m_Occluded.assign(visibleCount, 0);
+
+	unsigned int batchCount = (visibleCount + TEST_BATCH - 1) / TEST_BATCH;
+	this->m_JobPool.run(batchCount, [&](unsigned int batch) {
+		unsigned int end = std::min((batch + 1) * TEST_BATCH, visibleCount);
+		for (unsigned int k = batch * TEST_BATCH; k < end; k++)
+		{
+			this->m_Occluded[k] = this->isOccluded(bounds, visible[k], viewProjection) ? 1 : 0;
+		}
+	});
+
+	unsigned int kept = 0;
+	for (unsigned int k = 0; k < visibleCount; k++)
+	{
+		if (this->m_Occluded[k] == 0)
+		{
+			visible[kept++] = visible[k];
+		}
+	}
+	visible.resize(kept);
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_Stats.occluders = static_cast<unsigned int>(this->m_Occluders.size());
+	this->m_Stats.tested = visibleCount;
+	this->m_Stats.occluded = visibleCount - kept;
+	this->m_Stats.time = this->m_SelectionTime + elapsed.count();
+}
+
+const OcclusionStats& OcclusionCuller::getStats() const
+{
+	return this->m_Stats;
+}
+
+unsigned int OcclusionCuller::selectOccluders(const PatchBounds& bounds, const glm::vec3& cameraPosition, const std::vector<unsigned int>& candidates)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	this->m_Occluders = candidates;
+	if (this->m_OccluderMesh.heights.empty())
+	{
+		this->m_Occluders.clear();
+	}
+
+	// Squared distance from the camera to the closest point of the patch AABB
+	auto distance = [&bounds, &cameraPosition](unsigned int patch) {
+		float dx = std::max({ bounds.minX[patch] - cameraPosition.x, 0.0f, cameraPosition.x - bounds.maxX[patch] });
+		float dy = std::max({ bounds.minY[patch] - cameraPosition.y, 0.0f, cameraPosition.y - bounds.maxY[patch] });
+		float dz = std::max({ bounds.minZ[patch] - cameraPosition.z, 0.0f, cameraPosition.z - bounds.maxZ[patch] });
+		return dx * dx + dy * dy + dz * dz;
+	};
+
+	unsigned int count = std::min(MAX_OCCLUDERS, static_cast<unsigned int>(this->m_Occluders.size()));
+	std::partial_sort(this->m_Occluders.begin(), this->m_Occluders.begin() + count, this->m_Occluders.end(),
+		[&distance](unsigned int a, unsigned int b) { return distance(a) < distance(b); });
+	this->m_Occluders.resize(count);
+
+	// The selection order follows the distances, only the set matters for the version
+	std::vector<unsigned int> sorted = this->m_Occluders;
+	std::sort(sorted.begin(), sorted.end());
+	if (sorted != this->m_SortedOccluders)
+	{
+		this->m_SortedOccluders.swap(sorted);
+		this->m_OccluderVersion++;
+	}
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_SelectionTime = elapsed.count();
+
+	return this->m_OccluderVersion;
+}
+
+void OcclusionCuller::setupTriangles(const PatchBounds& bounds, const glm::mat4& viewProjection)
+{
+	this->m_Triangles.clear();
+
+	unsigned int gridSize = this->m_OccluderMesh.gridSize;
+	unsigned int rowLength = gridSize + 1;
+
+	std::vector<glm::vec4> screen(rowLength * rowLength);
+
+	for (unsigned int patch : this->m_Occluders)
+	{
+		const float* heights = &this->m_OccluderMesh.heights[patch * rowLength * rowLength];
+
+		for (unsigned int a = 0; a <= gridSize; a++)
+		{
+			for (unsigned int b = 0; b <= gridSize; b++)
+			{
+				float x = bounds.minX[patch] + (bounds.maxX[patch] - bounds.minX[patch]) * a / gridSize;
+				float z = bounds.minZ[patch] + (bounds.maxZ[patch] - bounds.minZ[patch]) * b / gridSize;
+				glm::vec4 clip = viewProjection * glm::vec4(x, heights[a * rowLength + b], z, 1.0f);
+
+				// w holds the clip w so vertices behind the near plane can be rejected
+				screen[a * rowLength + b] = glm::vec4(
+					(clip.x / clip.w * 0.5f + 0.5f) * this->m_Width,
+					(clip.y / clip.w * 0.5f + 0.5f) * this->m_Height,
+					clip.z / clip.w * 0.5f + 0.5f,
+					clip.w);
+			}
+		}
+
+		for (unsigned int a = 0; a < gridSize; a++)
+		{
+			for (unsigned int b = 0; b < gridSize; b++)
+			{
+				const glm::vec4& v00 = screen[a * rowLength + b];
+				const glm::vec4& v10 = screen[(a + 1) * rowLength + b];
+				const glm::vec4& v01 = screen[a * rowLength + b + 1];
+				const glm::vec4& v11 = screen[(a + 1) * rowLength + b + 1];
+
+				// Skipping an occluder is always safe, clipping is not worth it here
+				if (v00.w < NEAR_W || v10.w < NEAR_W || v01.w < NEAR_W || v11.w < NEAR_W)
+				{
+					continue;
+				}
+
+				this->m_Triangles.push_back({ { v00.x, v10.x, v11.x }, { v00.y, v10.y, v11.y }, { v00.z, v10.z, v11.z } });
+				this->m_Triangles.push_back({ { v00.x, v11.x, v01.x }, { v00.y, v11.y, v01.y }, { v00.z, v11.z, v01.z } });
+			}
+		}
+	}
+}
+
+void OcclusionCuller::rasterizeBand(unsigned int rowBegin, unsigned int rowEnd)
+{
+	float* depth = this->m_HiZ[0].data();
+	std::fill(depth + rowBegin * this->m_Width, depth + rowEnd * this->m_Width, 1.0f);
+
+	for (const ScreenTriangle& triangle : this->m_Triangles)
+	{
+		const float* x = triangle.x;
+		const float* y = triangle.y;
+
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (std::abs(area) < 1e-6f)
+		{
+			continue;
+		}
+
+		int minX = std::max(static_cast<int>(std::floor(std::min({ x[0], x[1], x[2] }))), 0);
+		int maxX = std::min(static_cast<int>(std::ceil(std::max({ x[0], x[1], x[2] }))), static_cast<int>(this->m_Width) - 1);
+		int minY = std::max(static_cast<int>(std::floor(std::min({ y[0], y[1], y[2] }))), static_cast<int>(rowBegin));
+		int maxY = std::min(static_cast<int>(std::ceil(std::max({ y[0], y[1], y[2] }))), static_cast<int>(rowEnd) - 1);
+		if (minX > maxX || minY > maxY)
+		{
+			continue;
+		}
+
+		/*
+		 * Edge functions e(px, py) = a * px + b * py + c, scaled by 1 / area so they are
+		 * the barycentric weights of the opposite vertex and work for both windings
+		 */
+		float invArea = 1.0f / area;
+		float ea[3], eb[3], ec[3];
+		for (int e = 0; e < 3; e++)
+		{
+			int v0 = (e + 1) % 3;
+			int v1 = (e + 2) % 3;
+			ea[e] = (y[v0] - y[v1]) * invArea;
+			eb[e] = (x[v1] - x[v0]) * invArea;
+			ec[e] = (x[v0] * y[v1] - x[v1] * y[v0]) * invArea;
+		}
+
+		// Rows are 4 aligned so the SIMD loop never reads past the row
+		minX &= ~3;
+
+		for (int row = minY; row <= maxY; row++)
+		{
+			float py = row + 0.5f;
+			float* depthRow = depth + row * this->m_Width;
+
+#if defined(OCCLUSION_CULLER_SSE)
+			__m128 px = _mm_add_ps(_mm_set1_ps(minX + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[0]), px), _mm_set1_ps(eb[0] * py + ec[0]));
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[1]), px), _mm_set1_ps(eb[1] * py + ec[1]));
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[2]), px), _mm_set1_ps(eb[2] * py + ec[2]));
+			__m128 step0 = _mm_set1_ps(ea[0] * 4.0f);
+			__m128 step1 = _mm_set1_ps(ea[1] * 4.0f);
+			__m128 step2 = _mm_set1_ps(ea[2] * 4.0f);
+			__m128 z0 = _mm_set1_ps(triangle.z[0]);
+			__m128 z1 = _mm_set1_ps(triangle.z[1]);
+			__m128 z2 = _mm_set1_ps(triangle.z[2]);
+			__m128 zero = _mm_setzero_ps();
+
+			for (int column = minX; column <= maxX; column += 4)
+			{
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+				if (_mm_movemask_ps(inside) != 0)
+				{
+					__m128 z = _mm_add_ps(_mm_mul_ps(w0, z0), _mm_add_ps(_mm_mul_ps(w1, z1), _mm_mul_ps(w2, z2)));
+					__m128 previous = _mm_loadu_ps(depthRow + column);
+					__m128 nearest = _mm_min_ps(previous, z);
+					_mm_storeu_ps(depthRow + column, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+				}
+
+				w0 = _mm_add_ps(w0, step0);
+				w1 = _mm_add_ps(w1, step1);
+				w2 = _mm_add_ps(w2, step2);
+			}
+#else
+			for (int column = minX; column <= maxX; column++)
+			{
+				float px = column + 0.5f;
+				float w0 = ea[0] * px + eb[0] * py + ec[0];
+				float w1 = ea[1] * px + eb[1] * py + ec[1];
+				float w2 = ea[2] * px + eb[2] * py + ec[2];
+				if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+				{
+					float z = w0 * triangle.z[0] + w1 * triangle.z[1] + w2 * triangle.z[2];
+					depthRow[column] = std::min(depthRow[column], z);
+				}
+			}
+#endif
+		}
+	}
+}
+
+void OcclusionCuller::buildHiZ()
+{
+	for (size_t level = 1; level < this->m_HiZ.size(); level++)
+	{
+		const std::vector<float>& source = this->m_HiZ[level - 1];
+		std::vector<float>& target = this->m_HiZ[level];
+
+		unsigned int sourceWidth = this->m_LevelWidth[level - 1];
+		unsigned int sourceHeight = this->m_LevelHeight[level - 1];
+
+		for (unsigned int y = 0; y < this->m_LevelHeight[level]; y++)
+		{
+			// Odd sizes clamp to the last row / column
+			unsigned int y0 = std::min(y * 2, sourceHeight - 1);
+			unsigned int y1 = std::min(y * 2 + 1, sourceHeight - 1);
+
+			for (unsigned int x = 0; x < this->m_LevelWidth[level]; x++)
+			{
+				unsigned int x0 = std::min(x * 2, sourceWidth - 1);
+				unsigned int x1 = std::min(x * 2 + 1, sourceWidth - 1);
+
+				target[y * this->m_LevelWidth[level] + x] = std::max(
+					std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+					std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::isOccluded(const PatchBounds& bounds, unsigned int patch, const glm::mat4& viewProjection) const
+{
+	float minX = std::numeric_limits<float>::max();
+	float minY = std::numeric_limits<float>::max();
+	float maxX = std::numeric_limits<float>::lowest();
+	float maxY = std::numeric_limits<float>::lowest();
+	float minDepth = std::numeric_limits<float>::max();
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec4 position(
+			(corner & 1) != 0 ? bounds.maxX[patch] : bounds.minX[patch],
+			(corner & 2) != 0 ? bounds.maxY[patch] : bounds.minY[patch],
+			(corner & 4) != 0 ? bounds.maxZ[patch] : bounds.minZ[patch],
+			1.0f);
+		glm::vec4 clip = viewProjection * position;
+
+		// Boxes crossing the near plane are never reported as occluded
+		if (clip.w < NEAR_W)
+		{
+			return false;
+		}
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * this->m_Width;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * this->m_Height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minDepth = std::min(minDepth, clip.z / clip.w * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+	int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+	int x1 = std::min(static_cast<int>(std::floor(maxX)), static_cast<int>(this->m_Width) - 1);
+	int y1 = std::min(static_cast<int>(std::floor(maxY)), static_cast<int>(this->m_Height) - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return false;
+	}
+
+	// Coarsest level where the rectangle still covers at most 2x2 texels (plus the straddle)
+	unsigned int extent = static_cast<unsigned int>(std::max(x1 - x0, y1 - y0));
+	unsigned int level = 0;
+	while ((extent >> level) > 1 && level + 1 < this->m_HiZ.size())
+	{
+		level++;
+	}
+
+	const std::vector<float>& hiZ = this->m_HiZ[level];
+	unsigned int levelWidth = this->m_LevelWidth[level];
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			if (minDepth <= hiZ[y * levelWidth + x])
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+#include "patch_bounds.h"
+#include "job_pool.h"
+
+/*
+ * Conservative low resolution copy of the terrain used as occluder geometry. Every
+ * patch has (gridSize + 1)^2 vertices whose height is the minimum of the heightmap
+ * around them, so the mesh never rises above the rendered surface
+ */
+struct OccluderMesh
+{
+	unsigned int gridSize;
+	std::vector<float> heights;
+};
+
+OccluderMesh computeOccluderMesh(const unsigned char* data, int width, int height, int nrChannels, unsigned int rez,
+	const std::vector<unsigned int>& patchOrder, unsigned int gridSize, float minTessLevel);
+
+/*
+ * Counters of the last cull() call
+ */
+struct OcclusionStats
+{
+	unsigned int occluders;
+	unsigned int tested;
+	unsigned int occluded;
+	float time; // microseconds
+};
+
+/*
+ * Software hierarchical-Z occlusion culling. The nearest visible patches are
+ * rasterized into a small CPU depth buffer (SSE, one screen band per job), a max
+ * depth pyramid is built from it and every visible patch AABB is tested against it
+ */
+class OcclusionCuller
+{
+public:
+	OcclusionCuller(unsigned int width, unsigned int height, JobPool& jobPool);
+
+	void setOccluderMesh(OccluderMesh mesh);
+
+	/*
+	 * Removes the occluded patches from visible, keeping the order
+	 */
+	void cull(const PatchBounds& bounds, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, std::vector<unsigned int>& visible);
+
+	/*
+	 * Two step form of cull() for callers that only test part of the visible patches.
+	 * The occluders are picked among all the candidates and the returned version
+	 * changes whenever the occluder set does
+	 */
+	unsigned int selectOccluders(const PatchBounds& bounds, const glm::vec3& cameraPosition, const std::vector<unsigned int>& candidates);
+	void cullSelected(const PatchBounds& bounds, const glm::mat4& viewProjection, std::vector<unsigned int>& visible);
+
+	const OcclusionStats& getStats() const;
+
+private:
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	unsigned int m_Width;
+	unsigned int m_Height;
+	JobPool& m_JobPool;
+
+	OccluderMesh m_OccluderMesh;
+	OcclusionStats m_Stats;
+
+	std::vector<ScreenTriangle> m_Triangles;
+	std::vector<unsigned int> m_Occluders;
+	std::vector<unsigned int> m_SortedOccluders;
+	unsigned int m_OccluderVersion;
+	float m_SelectionTime;
+	std::vector<unsigned char> m_Occluded;
+
+	// Level 0 is the depth buffer, every next level keeps the max of 2x2 texels
+	std::vector<std::vector<float>> m_HiZ;
+	std::vector<unsigned int> m_LevelWidth;
+	std::vector<unsigned int> m_LevelHeight;
+
+	void setupTriangles(const PatchBounds& bounds, const glm::mat4& viewProjection);
+	void rasterizeBand(unsigned int rowBegin, unsigned int rowEnd);
+	void buildHiZ();
+	bool isOccluded(const PatchBounds& bounds, unsigned int patch, const glm::mat4& viewProjection) const;
+};
@@ -0,0 +1,211 @@
+#include "patch_bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+unsigned int PatchBounds::size() const
+{
+	return static_cast<unsigned int>(this->minX.size());
+}
+
+void PatchBounds::resize(unsigned int count)
+{
+	this->minX.resize(count);
+	this->minY.resize(count);
+	this->minZ.resize(count);
+	this->maxX.resize(count);
+	this->maxY.resize(count);
+	this->maxZ.resize(count);
+	this->coneX.resize(count);
+	this->coneY.resize(count);
+	this->coneZ.resize(count);
+	this->coneSin.resize(count);
+	this->coneCos.resize(count);
+}
+
+int patchBoundsMargin(int width, int height, unsigned int rez, float minTessLevel)
+{
+	/*
+	 * The TES samples the mip of the vertex spacing and its parent, whose texels span up
+	 * to twice the spacing. A bilinear sample reaches 1.5 texels of its level away
+	 */
+	float spacing = std::max(width, height) / (rez * std::max(minTessLevel, 1.0f));
+	return static_cast<int>(std::ceil(3.0f * spacing)) + 1;
+}
+
+/*
+ * Normal cone of a patch from the range of its height gradients. Heights sampled at
+ * any tessellation level or mip are averages of texels, so the slope of every face
+ * along x and z stays within the texel slopes. Normals (-gx, 1, -gz) of that gradient
+ * box form a spherical quad, bounded by the cone around its four corners
+ */
+static void computeNormalCone(float minGradientX, float maxGradientX, float minGradientZ, float maxGradientZ,
+	float& axisX, float& axisY, float& axisZ, float& sinAngle, float& cosAngle)
+{
+	// Triangles of the tessellated quads also have diagonal edges, a small slack covers them
+	const float SLACK = 0.05f;
+
+	float gradientsX[4] = { minGradientX, maxGradientX, minGradientX, maxGradientX };
+	float gradientsZ[4] = { minGradientZ, minGradientZ, maxGradientZ, maxGradientZ };
+	float normals[4][3];
+
+	float sumX = 0.0f, sumY = 0.0f, sumZ = 0.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		float length = std::sqrt(gradientsX[c] * gradientsX[c] + 1.0f + gradientsZ[c] * gradientsZ[c]);
+		normals[c][0] = -gradientsX[c] / length;
+		normals[c][1] = 1.0f / length;
+		normals[c][2] = -gradientsZ[c] / length;
+
+		sumX += normals[c][0];
+		sumY += normals[c][1];
+		sumZ += normals[c][2];
+	}
+
+	float length = std::sqrt(sumX * sumX + sumY * sumY + sumZ * sumZ);
+	axisX = sumX / length;
+	axisY = sumY / length;
+	axisZ = sumZ / length;
+
+	float minCos = 1.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		minCos = std::min(minCos, axisX * normals[c][0] + axisY * normals[c][1] + axisZ * normals[c][2]);
+	}
+
+	float angle = std::acos(std::clamp(minCos, -1.0f, 1.0f)) + SLACK;
+	if (angle >= 1.5707963f)
+	{
+		// Never back facing as a whole
+		sinAngle = 1.0f;
+		cosAngle = 0.0f;
+	}
+	else
+	{
+		sinAngle = std::sin(angle);
+		cosAngle = std::cos(angle);
+	}
+}
+
+PatchBounds computePatchBounds(const unsigned char* data, int width, int height, int nrChannels, unsigned int rez,
+	const std::vector<unsigned int>& patchOrder, float minTessLevel)
+{
+	PatchBounds bounds;
+	bounds.resize(static_cast<unsigned int>(patchOrder.size()));
+
+	float heightInMin = -height / 2.0f;
+	float widthInMin = -width / 2.0f;
+
+	// The TES reads the height from the green channel
+	int channel = nrChannels > 1 ? 1 : 0;
+
+	int margin = patchBoundsMargin(width, height, rez, minTessLevel);
+
+	// Texels covered by a patch column or row plus the footprint of the mips sampled by the TES
+	auto getRange = [rez, margin](int size, unsigned int index, int& first, int& last)
+	{
+		first = std::max(static_cast<int>(std::floor(size * index / (float)rez)) - margin, 0);
+		last = std::min(static_cast<int>(std::ceil(size * (index + 1) / (float)rez)) + margin, size - 1);
+	};
+
+	/*
+	 * The windows are separable: the ranges along x of every row for each patch column,
+	 * then those along y for each patch. Steps along z are taken at the row they start on
+	 */
+	struct RowRange
+	{
+		unsigned char minValue;
+		unsigned char maxValue;
+		int minStepX, maxStepX;
+		int minStepZ, maxStepZ;
+	};
+
+	std::vector<RowRange> rowRanges(static_cast<std::size_t>(rez - 1) * height);
+	for (unsigned int i = 0; i < rez - 1; i++)
+	{
+		int x0, x1;
+		getRange(width, i, x0, x1);
+
+		for (int y = 0; y < height; y++)
+		{
+			RowRange range = { 255, 0, 255, -255, 255, -255 };
+			for (int x = x0; x <= x1; x++)
+			{
+				unsigned char value = data[(y * width + x) * nrChannels + channel];
+				range.minValue = std::min(range.minValue, value);
+				range.maxValue = std::max(range.maxValue, value);
+
+				// One texel is one world unit along x and z
+				if (x < x1)
+				{
+					int step = data[(y * width + x + 1) * nrChannels + channel] - value;
+					range.minStepX = std::min(range.minStepX, step);
+					range.maxStepX = std::max(range.maxStepX, step);
+				}
+				if (y < height - 1)
+				{
+					int step = data[((y + 1) * width + x) * nrChannels + channel] - value;
+					range.minStepZ = std::min(range.minStepZ, step);
+					range.maxStepZ = std::max(range.maxStepZ, step);
+				}
+			}
+			rowRanges[static_cast<std::size_t>(i) * height + y] = range;
+		}
+	}
+
+	for (unsigned int patch = 0; patch < bounds.size(); patch++)
+	{
+		unsigned int i = patchOrder[patch] / (rez - 1);
+		unsigned int j = patchOrder[patch] % (rez - 1);
+
+		int y0, y1;
+		getRange(height, j, y0, y1);
+
+		unsigned char minValue = 255;
+		unsigned char maxValue = 0;
+		int minStepX = 255, maxStepX = -255;
+		int minStepZ = 255, maxStepZ = -255;
+		for (int y = y0; y <= y1; y++)
+		{
+			const RowRange& range = rowRanges[static_cast<std::size_t>(i) * height + y];
+			minValue = std::min(minValue, range.minValue);
+			maxValue = std::max(maxValue, range.maxValue);
+			minStepX = std::min(minStepX, range.minStepX);
+			maxStepX = std::max(maxStepX, range.maxStepX);
+			if (y < y1)
+			{
+				minStepZ = std::min(minStepZ, range.minStepZ);
+				maxStepZ = std::max(maxStepZ, range.maxStepZ);
+			}
+		}
+
+		bounds.minX[patch] = widthInMin + width * i / (float)rez;
+		bounds.maxX[patch] = widthInMin + width * (i + 1) / (float)rez;
+		bounds.minZ[patch] = heightInMin + height * j / (float)rez;
+		bounds.maxZ[patch] = heightInMin + height * (j + 1) / (float)rez;
+		bounds.minY[patch] = minValue / 255.0f * TERRAIN_HEIGHT_SCALE + TERRAIN_HEIGHT_OFFSET;
+		bounds.maxY[patch] = maxValue / 255.0f * TERRAIN_HEIGHT_SCALE + TERRAIN_HEIGHT_OFFSET;
+
+		const float HEIGHT_SCALE = TERRAIN_HEIGHT_SCALE / 255.0f;
+		computeNormalCone(minStepX * HEIGHT_SCALE, maxStepX * HEIGHT_SCALE, minStepZ * HEIGHT_SCALE, maxStepZ * HEIGHT_SCALE,
+			bounds.coneX[patch], bounds.coneY[patch], bounds.coneZ[patch], bounds.coneSin[patch], bounds.coneCos[patch]);
+	}
+
+	return bounds;
+}
+
+std::vector<float> packHeightBounds(const PatchBounds& bounds, unsigned int rez, const std::vector<unsigned int>& patchOrder)
+{
+	std::vector<float> texels(rez * rez * 2, 0.0f);
+
+	for (unsigned int patch = 0; patch < bounds.size(); patch++)
+	{
+		unsigned int i = patchOrder[patch] / (rez - 1);
+		unsigned int j = patchOrder[patch] % (rez - 1);
+
+		texels[(j * rez + i) * 2] = bounds.minY[patch];
+		texels[(j * rez + i) * 2 + 1] = bounds.maxY[patch];
+	}
+
+	return texels;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+/*
+ * Terrain height of a heightmap value v (0..1): v * TERRAIN_HEIGHT_SCALE + TERRAIN_HEIGHT_OFFSET.
+ * Injected into the terrain shaders as HEIGHT_SCALE and HEIGHT_OFFSET
+ */
+static const float TERRAIN_HEIGHT_SCALE = 64.0f;
+static const float TERRAIN_HEIGHT_OFFSET = -16.0f;
+
+/*
+ * World space AABBs and normal cones of the terrain patches, stored as structure of
+ * arrays so the culling kernels can load several patches per SIMD register
+ */
+struct PatchBounds
+{
+	std::vector<float> minX;
+	std::vector<float> minY;
+	std::vector<float> minZ;
+	std::vector<float> maxX;
+	std::vector<float> maxY;
+	std::vector<float> maxZ;
+
+	// Cone holding every face normal of the patch: unit axis and sin/cos of its half angle
+	std::vector<float> coneX;
+	std::vector<float> coneY;
+	std::vector<float> coneZ;
+	std::vector<float> coneSin;
+	std::vector<float> coneCos;
+
+	unsigned int size() const;
+	void resize(unsigned int count);
+};
+
+/*
+ * Texels added around every patch so the bounds also hold the heights the TES reads
+ * from the coarser mips. minTessLevel is the lowest level the tessellation may use,
+ * its vertex spacing selects the coarsest mip
+ */
+int patchBoundsMargin(int width, int height, unsigned int rez, float minTessLevel);
+
+/*
+ * Builds the bounds of the (rez - 1) * (rez - 1) patches generated in main() using
+ * the heightmap texels covered by each patch. Patch k covers the grid cell
+ * patchOrder[k] (i * (rez - 1) + j). Heights follow the TES, see TERRAIN_HEIGHT_SCALE.
+ * The normal cones come from the range of the texel to texel height gradients
+ */
+PatchBounds computePatchBounds(const unsigned char* data, int width, int height, int nrChannels, unsigned int rez,
+	const std::vector<unsigned int>& patchOrder, float minTessLevel);
+
+/*
+ * Packs the min/max heights into a rez * rez RG texture, texel (i, j) holds the
+ * patch of grid cell (i, j). Used by the TCS to discard off-screen patches
+ */
+std::vector<float> packHeightBounds(const PatchBounds& bounds, unsigned int rez, const std::vector<unsigned int>& patchOrder);
@@ -0,0 +1,194 @@
+#include "patch_draw_list.h"
+
+#include <algorithm>
+
+#include "../renderer/gl_state.h"
+
+static GLint getRecordAlignment()
+{
+	GLint alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	return alignment > 0 ? alignment : 256;
+}
+
+PatchDrawList::PatchDrawList()
+	: m_BatchCount(0), m_RecordBuffer(0)
+{
+	// Only the DRAW_DATA variant of the terrain program reads the records
+	if (GLAD_GL_VERSION_4_6)
+	{
+		glGenBuffers(1, &this->m_RecordBuffer);
+	}
+}
+
+PatchDrawList::~PatchDrawList()
+{
+	if (this->m_RecordBuffer != 0)
+	{
+		glDeleteBuffers(1, &this->m_RecordBuffer);
+	}
+}
+
+void PatchDrawList::clear()
+{
+	// Batches are kept, their arrays keep the capacity of the previous frames
+	for (std::size_t b = 0; b < this->m_BatchCount; b++)
+	{
+		Batch& batch = this->m_Batches[b];
+		batch.first.clear();
+		batch.count.clear();
+		batch.offset.clear();
+		batch.records.clear();
+	}
+	this->m_BatchCount = 0;
+}
+
+void PatchDrawList::add(unsigned int material, const std::vector<unsigned int>& visiblePatches, GLsizei indicesPerPatch, const ChunkDrawData& data)
+{
+	if (visiblePatches.empty())
+	{
+		return;
+	}
+
+	Batch& batch = this->getBatch(material);
+	std::size_t chunkFirst = batch.first.size();
+
+	for (unsigned int patch : visiblePatches)
+	{
+		GLint first = static_cast<GLint>(patch) * indicesPerPatch;
+		if (batch.first.size() > chunkFirst && batch.first.back() + batch.count.back() == first)
+		{
+			batch.count.back() += indicesPerPatch;
+		}
+		else
+		{
+			batch.first.push_back(first);
+			batch.count.push_back(indicesPerPatch);
+			batch.records.push_back(data);
+		}
+	}
+
+	// Byte offsets into the bound element buffer
+	for (std::size_t k = chunkFirst; k < batch.first.size(); k++)
+	{
+		batch.offset.push_back(reinterpret_cast<const void*>(static_cast<GLintptr>(batch.first[k]) * sizeof(GLuint)));
+	}
+}
+
+void PatchDrawList::build(const std::vector<unsigned int>& visiblePatches, GLsizei indicesPerPatch)
+{
+	this->clear();
+	this->add(0, visiblePatches, indicesPerPatch, { glm::vec2(0.0f), 1.0f, 0.0f });
+}
+
+void PatchDrawList::draw(const std::function<void(unsigned int)>& bindMaterial) const
+{
+	for (std::size_t b = 0; b < this->m_BatchCount; b++)
+	{
+		const Batch& batch = this->m_Batches[b];
+		if (bindMaterial)
+		{
+			bindMaterial(batch.material);
+		}
+		this->drawBatch(batch);
+	}
+}
+
+void PatchDrawList::draw(RingBuffer& ring, const std::function<void(unsigned int)>& bindMaterial) const
+{
+	if (!GLAD_GL_VERSION_4_3)
+	{
+		this->draw(bindMaterial);
+		return;
+	}
+
+	static const GLint recordAlignment = getRecordAlignment();
+	bool drawData = GLAD_GL_VERSION_4_6 != 0;
+
+	GlState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.getBuffer());
+	for (std::size_t b = 0; b < this->m_BatchCount; b++)
+	{
+		const Batch& batch = this->m_Batches[b];
+		if (bindMaterial)
+		{
+			bindMaterial(batch.material);
+		}
+
+		GLsizeiptr commandSize = static_cast<GLsizeiptr>(batch.first.size() * sizeof(DrawElementsIndirectCommand));
+		GLsizeiptr recordSize = static_cast<GLsizeiptr>(batch.records.size() * sizeof(ChunkDrawData));
+		GLintptr commandOffset = 0;
+		GLintptr recordOffset = 0;
+		void* commandDestination = ring.allocate(commandSize, sizeof(GLuint), commandOffset);
+		void* recordDestination = commandDestination != nullptr && drawData ? ring.allocate(recordSize, recordAlignment, recordOffset) : nullptr;
+		if (commandDestination == nullptr || (drawData && recordDestination == nullptr))
+		{
+			GlState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			this->drawBatch(batch);
+			GlState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.getBuffer());
+			continue;
+		}
+
+		DrawElementsIndirectCommand* commands = static_cast<DrawElementsIndirectCommand*>(commandDestination);
+		for (std::size_t k = 0; k < batch.first.size(); k++)
+		{
+			commands[k] = { static_cast<GLuint>(batch.count[k]), 1, static_cast<GLuint>(batch.first[k]), 0, 0 };
+		}
+		if (drawData)
+		{
+			std::copy(batch.records.begin(), batch.records.end(), static_cast<ChunkDrawData*>(recordDestination));
+		}
+		ring.commit();
+
+		if (drawData)
+		{
+			GlState::get().bindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, ring.getBuffer(), recordOffset, recordSize);
+		}
+		glMultiDrawElementsIndirect(GL_PATCHES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandOffset),
+			static_cast<GLsizei>(batch.first.size()), 0);
+	}
+	GlState::get().bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+GLsizeiptr PatchDrawList::getRingSize(std::size_t ranges, std::size_t materials)
+{
+	// Each material may lose up to one alignment to the command array and one to the records
+	if (!GLAD_GL_VERSION_4_6)
+	{
+		return static_cast<GLsizeiptr>(ranges * sizeof(DrawElementsIndirectCommand) + materials * sizeof(GLuint));
+	}
+	return static_cast<GLsizeiptr>(ranges * (sizeof(DrawElementsIndirectCommand) + sizeof(ChunkDrawData))
+		+ materials * (sizeof(GLuint) + getRecordAlignment()));
+}
+
+PatchDrawList::Batch& PatchDrawList::getBatch(unsigned int material)
+{
+	for (std::size_t b = 0; b < this->m_BatchCount; b++)
+	{
+		if (this->m_Batches[b].material == material)
+		{
+			return this->m_Batches[b];
+		}
+	}
+
+	if (this->m_BatchCount == this->m_Batches.size())
+	{
+		this->m_Batches.emplace_back();
+	}
+
+	Batch& batch = this->m_Batches[this->m_BatchCount++];
+	batch.material = material;
+	return batch;
+}
+
+void PatchDrawList::drawBatch(const Batch& batch) const
+{
+	if (this->m_RecordBuffer != 0)
+	{
+		GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_RecordBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, batch.records.size() * sizeof(ChunkDrawData), batch.records.data(), GL_STREAM_DRAW);
+		GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		GlState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, this->m_RecordBuffer);
+	}
+
+	glMultiDrawElements(GL_PATCHES, batch.count.data(), GL_UNSIGNED_INT, batch.offset.data(), static_cast<GLsizei>(batch.count.size()));
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/vec2.hpp"
+
+#include "../renderer/ring_buffer.h"
+
+/*
+ * Layout of the commands read by glMultiDrawElementsIndirect
+ */
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/*
+ * Per-draw data of a chunk, std430 DrawRecord of the vertex shader. With the DRAW_DATA
+ * shader variant (GL 4.6) it is fetched by gl_DrawID from DRAW_DATA_BINDING, other
+ * contexts never upload it
+ */
+struct ChunkDrawData
+{
+	glm::vec2 offset;	// XZ translation of the surface
+	GLfloat lodScale;	// multiplies the tessellation levels
+	GLfloat padding;	// std430 rounds the record to the 8 byte alignment of offset
+};
+
+static const GLuint DRAW_DATA_BINDING = 3;
+
+/*
+ * Count/offset arrays for glMultiDrawElements over the patch index buffer. Consecutive
+ * visible patches of a chunk are merged into a single range so a fully visible terrain
+ * is still one draw. Draws are grouped by material, each group is one submission
+ */
+class PatchDrawList
+{
+public:
+	PatchDrawList();
+	~PatchDrawList();
+
+	PatchDrawList(const PatchDrawList&) = delete;
+	PatchDrawList& operator=(const PatchDrawList&) = delete;
+
+	void clear();
+
+	/*
+	 * Appends the visible patches of a chunk, every range gets a copy of its draw data
+	 */
+	void add(unsigned int material, const std::vector<unsigned int>& visiblePatches, GLsizei indicesPerPatch, const ChunkDrawData& data);
+
+	/*
+	 * Single surface list: clear() then add() with material 0 and neutral draw data
+	 */
+	void build(const std::vector<unsigned int>& visiblePatches, GLsizei indicesPerPatch);
+
+	/*
+	 * One glMultiDrawElements per material, bindMaterial is called before each of them
+	 */
+	void draw(const std::function<void(unsigned int)>& bindMaterial = nullptr) const;
+
+	/*
+	 * Same draws from indirect commands written to the ring buffer (GL 4.3), the driver
+	 * then has no client arrays to copy. On GL 4.6 the draw records go to the same section
+	 * and are bound to DRAW_DATA_BINDING. Falls back to draw() when the section is full
+	 */
+	void draw(RingBuffer& ring, const std::function<void(unsigned int)>& bindMaterial = nullptr) const;
+
+	/*
+	 * Upper bound of the ring space draw(RingBuffer&) takes for a number of ranges
+	 * (draws) spread over a number of materials
+	 */
+	static GLsizeiptr getRingSize(std::size_t ranges, std::size_t materials);
+
+private:
+	struct Batch
+	{
+		unsigned int material;
+		std::vector<GLint> first;
+		std::vector<GLsizei> count;
+		std::vector<const void*> offset;
+		std::vector<ChunkDrawData> records;
+	};
+
+	std::vector<Batch> m_Batches;
+	std::size_t m_BatchCount;
+
+	// Draw records of the client array path, GL 4.6
+	GLuint m_RecordBuffer;
+
+	Batch& getBatch(unsigned int material);
+	void drawBatch(const Batch& batch) const;
+};
@@ -0,0 +1,116 @@
+#include "patch_instancer.h"
+
+#include "patch_draw_list.h"
+#include "../renderer/gl_state.h"
+
+// Unit patch corners, in the order of the patch indices
+static const GLfloat PATCH_CORNERS[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+
+PatchInstancer::PatchInstancer(const std::vector<unsigned int>& indices, unsigned int rez)
+	: m_RecordBuffer(0)
+{
+	// Corners 0 and 3 are the min and max grid vertices of the patch
+	for (std::size_t k = 0; k + 3 < indices.size(); k += 4)
+	{
+		unsigned int first = indices[k];
+		unsigned int last = indices[k + 3];
+		this->m_Patches.push_back({
+			static_cast<GLushort>(first / rez),
+			static_cast<GLushort>(first % rez),
+			static_cast<GLushort>(last / rez - first / rez),
+			static_cast<GLushort>(last % rez - first % rez) });
+	}
+
+	glGenVertexArrays(1, &this->m_VertexArray);
+	GlState::get().bindVertexArray(this->m_VertexArray);
+
+	glGenBuffers(1, &this->m_CornerBuffer);
+	GlState::get().bindBuffer(GL_ARRAY_BUFFER, this->m_CornerBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PATCH_CORNERS), PATCH_CORNERS, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glGenBuffers(1, &this->m_InstanceBuffer);
+	glEnableVertexAttribArray(PATCH_INSTANCE_LOCATION);
+	glVertexAttribDivisor(PATCH_INSTANCE_LOCATION, 1);
+
+	if (GLAD_GL_VERSION_4_6)
+	{
+		ChunkDrawData neutral = { glm::vec2(0.0f), 1.0f, 0.0f };
+		glGenBuffers(1, &this->m_RecordBuffer);
+		GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, this->m_RecordBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ChunkDrawData), &neutral, GL_STATIC_DRAW);
+		GlState::get().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
+
+PatchInstancer::~PatchInstancer()
+{
+	glDeleteVertexArrays(1, &this->m_VertexArray);
+	glDeleteBuffers(1, &this->m_CornerBuffer);
+	glDeleteBuffers(1, &this->m_InstanceBuffer);
+	if (this->m_RecordBuffer != 0)
+	{
+		glDeleteBuffers(1, &this->m_RecordBuffer);
+	}
+	GlState::get().invalidate();
+}
+
+void PatchInstancer::draw(RingBuffer& ring, const std::vector<unsigned int>& visiblePatches)
+{
+	if (visiblePatches.empty())
+	{
+		return;
+	}
+
+	GlState::get().bindVertexArray(this->m_VertexArray);
+
+	GLsizeiptr size = static_cast<GLsizeiptr>(visiblePatches.size() * sizeof(PatchInstance));
+	GLintptr offset = 0;
+	PatchInstance* destination = static_cast<PatchInstance*>(ring.allocate(size, sizeof(PatchInstance), offset));
+	if (destination != nullptr)
+	{
+		for (std::size_t k = 0; k < visiblePatches.size(); k++)
+		{
+			destination[k] = this->m_Patches[visiblePatches[k]];
+		}
+		ring.commit();
+		this->bindInstances(ring.getBuffer(), offset);
+	}
+	else
+	{
+		this->m_Staging.resize(visiblePatches.size());
+		for (std::size_t k = 0; k < visiblePatches.size(); k++)
+		{
+			this->m_Staging[k] = this->m_Patches[visiblePatches[k]];
+		}
+		GlState::get().bindBuffer(GL_ARRAY_BUFFER, this->m_InstanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, size, this->m_Staging.data(), GL_STREAM_DRAW);
+		this->bindInstances(this->m_InstanceBuffer, 0);
+	}
+
+	if (this->m_RecordBuffer != 0)
+	{
+		GlState::get().bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, this->m_RecordBuffer);
+	}
+
+	glDrawArraysInstanced(GL_PATCHES, 0, 4, static_cast<GLsizei>(visiblePatches.size()));
+}
+
+GLsizeiptr PatchInstancer::getRingSize(std::size_t patches)
+{
+	// One alignment lost at most
+	return static_cast<GLsizeiptr>((patches + 1) * sizeof(PatchInstance));
+}
+
+GLsizeiptr PatchInstancer::getInstanceSize()
+{
+	return sizeof(PatchInstance);
+}
+
+void PatchInstancer::bindInstances(GLuint buffer, GLintptr offset) const
+{
+	// The records move every frame, the pointer is set again before each draw
+	GlState::get().bindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribIPointer(PATCH_INSTANCE_LOCATION, 4, GL_UNSIGNED_SHORT, sizeof(PatchInstance), reinterpret_cast<const void*>(offset));
+}
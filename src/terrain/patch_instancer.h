@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+#include "glad/glad.h"
+
+#include "../renderer/ring_buffer.h"
+
+/*
+ * Instance record of a patch, aPatch of the INSTANCED vertex shader: its first grid vertex
+ * and its span in patches on each axis (1, more for the coarse quadtree node patches, which
+ * are not always square)
+ */
+struct PatchInstance
+{
+	GLushort x;
+	GLushort y;
+	GLushort spanX;
+	GLushort spanY;
+};
+
+static const GLuint PATCH_INSTANCE_LOCATION = 2;
+
+/*
+ * Draws the visible patches as one 4 vertex unit patch instanced once per patch. Each
+ * instance is placed by its 8 byte record, written to the ring buffer every frame, so the
+ * geometry is the unit patch instead of the rez * rez grid plus 4 indices per patch
+ */
+class PatchInstancer
+{
+public:
+	/*
+	 * Records of every patch of the index buffer (patches, then coarse node patches) are
+	 * read from their corners, the grid has rez vertices per side
+	 */
+	PatchInstancer(const std::vector<unsigned int>& indices, unsigned int rez);
+	~PatchInstancer();
+
+	PatchInstancer(const PatchInstancer&) = delete;
+	PatchInstancer& operator=(const PatchInstancer&) = delete;
+
+	/*
+	 * One glDrawArraysInstanced over the visible patches, binds its own vertex array.
+	 * The records go to a buffer of the instancer when the ring section is full
+	 */
+	void draw(RingBuffer& ring, const std::vector<unsigned int>& visiblePatches);
+
+	/*
+	 * Ring space draw() takes for a number of visible patches
+	 */
+	static GLsizeiptr getRingSize(std::size_t patches);
+
+	// Bytes of instance records per visible patch, against 4 indices for the indexed draws
+	static GLsizeiptr getInstanceSize();
+
+private:
+	GLuint m_VertexArray;
+	GLuint m_CornerBuffer;
+	GLuint m_InstanceBuffer;
+
+	// Neutral draw record for the DRAW_DATA variant, gl_DrawID is 0
+	GLuint m_RecordBuffer;
+
+	std::vector<PatchInstance> m_Patches;
+	std::vector<PatchInstance> m_Staging;
+
+	void bindInstances(GLuint buffer, GLintptr offset) const;
+};
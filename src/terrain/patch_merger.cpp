@@ -0,0 +1,110 @@
+#include "patch_merger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "glm/geometric.hpp"
+
+void appendCoarsePatchIndices(const PatchQuadtree& quadtree, unsigned int rez, std::vector<unsigned int>& indices)
+{
+	const std::vector<unsigned int>& patchOrder = quadtree.getPatchOrder();
+
+	for (unsigned int index = 0; index < quadtree.getNodeCount(); index++)
+	{
+		const QuadtreeNode& node = quadtree.getNode(index);
+
+		// Depth first order starts a node at its min cell and ends it at its max cell
+		unsigned int firstCell = patchOrder[node.first];
+		unsigned int lastCell = patchOrder[node.first + node.count - 1];
+		unsigned int i0 = firstCell / (rez - 1);
+		unsigned int j0 = firstCell % (rez - 1);
+		unsigned int i1 = lastCell / (rez - 1) + 1;
+		unsigned int j1 = lastCell % (rez - 1) + 1;
+
+		indices.push_back(i0 * rez + j0);
+		indices.push_back(i1 * rez + j0);
+		indices.push_back(i0 * rez + j1);
+		indices.push_back(i1 * rez + j1);
+	}
+}
+
+PatchMerger::PatchMerger(float pixelThreshold)
+	: m_PixelThreshold(pixelThreshold)
+	, m_Stats { 0, 0, 0.0f }
+{
+}
+
+void PatchMerger::merge(const PatchQuadtree& quadtree, const glm::vec3& eye, const glm::mat4& projection, float viewportHeight,
+	std::vector<unsigned int>& visible)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	this->m_Kept.clear();
+	this->m_Coarse.clear();
+	this->m_Stats.merged = 0;
+
+	if (quadtree.getNodeCount() > 0 && !visible.empty())
+	{
+		// Pixels covered by one world unit at unit distance
+		float pixelScale = projection[1][1] * viewportHeight * 0.5f;
+		this->mergeNode(quadtree, 0, eye, pixelScale, visible);
+
+		unsigned int patchCount = quadtree.getNode(0).count;
+		visible.swap(this->m_Kept);
+		for (unsigned int node : this->m_Coarse)
+		{
+			visible.push_back(patchCount + node);
+		}
+	}
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_Stats.coarsePatches = static_cast<unsigned int>(this->m_Coarse.size());
+	this->m_Stats.time = elapsed.count();
+}
+
+const MergeStats& PatchMerger::getStats() const
+{
+	return this->m_Stats;
+}
+
+void PatchMerger::mergeNode(const PatchQuadtree& quadtree, unsigned int index, const glm::vec3& eye, float pixelScale,
+	const std::vector<unsigned int>& visible)
+{
+	const QuadtreeNode& node = quadtree.getNode(index);
+
+	auto begin = std::lower_bound(visible.begin(), visible.end(), node.first);
+	auto end = std::lower_bound(begin, visible.end(), node.first + node.count);
+	if (begin == end)
+	{
+		return;
+	}
+
+	// Size of the node AABB seen from its closest point, an upper bound of its projection
+	glm::vec3 minCorner(node.minX, node.minY, node.minZ);
+	glm::vec3 maxCorner(node.maxX, node.maxY, node.maxZ);
+	float distance = glm::distance(eye, glm::clamp(eye, minCorner, maxCorner));
+	float pixels = glm::distance(minCorner, maxCorner) * pixelScale / std::max(distance, 1e-3f);
+
+	// A single visible patch gains nothing from being drawn as its whole node
+	if (pixels < this->m_PixelThreshold && end - begin > 1)
+	{
+		this->m_Coarse.push_back(index);
+		this->m_Stats.merged += static_cast<unsigned int>(end - begin);
+		return;
+	}
+
+	if (node.isLeaf())
+	{
+		this->m_Kept.insert(this->m_Kept.end(), begin, end);
+		return;
+	}
+
+	for (int child : node.children)
+	{
+		if (child >= 0)
+		{
+			this->mergeNode(quadtree, child, eye, pixelScale, visible);
+		}
+	}
+}
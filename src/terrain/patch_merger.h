@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+#include "patch_quadtree.h"
+
+/*
+ * Appends the four corners of every quadtree node to the patch indices, in node order.
+ * Entry patchCount + node of a visible list then draws the whole node as one coarse
+ * patch, the TES samples the heightmap across it like for a regular patch
+ */
+void appendCoarsePatchIndices(const PatchQuadtree& quadtree, unsigned int rez, std::vector<unsigned int>& indices);
+
+/*
+ * Counters of the last merge() call
+ */
+struct MergeStats
+{
+	unsigned int merged;
+	unsigned int coarsePatches;
+	float time; // microseconds
+};
+
+/*
+ * Replaces the visible patches of every quadtree node projecting below a pixel
+ * threshold by its coarse patch. Distant patches of wide views then stop paying the
+ * TCS/TES setup one by one; the T-junctions left against full patches stay below
+ * the threshold
+ */
+class PatchMerger
+{
+public:
+	explicit PatchMerger(float pixelThreshold);
+
+	/*
+	 * visible must be ascending. The kept patches stay first, followed by the coarse
+	 * patches, so the list stays ascending for PatchDrawList
+	 */
+	void merge(const PatchQuadtree& quadtree, const glm::vec3& eye, const glm::mat4& projection, float viewportHeight,
+		std::vector<unsigned int>& visible);
+
+	const MergeStats& getStats() const;
+
+private:
+	float m_PixelThreshold;
+	MergeStats m_Stats;
+
+	std::vector<unsigned int> m_Kept;
+	std::vector<unsigned int> m_Coarse;
+
+	void mergeNode(const PatchQuadtree& quadtree, unsigned int index, const glm::vec3& eye, float pixelScale,
+		const std::vector<unsigned int>& visible);
+};
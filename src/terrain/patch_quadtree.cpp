@@ -0,0 +1,162 @@
+#include "patch_quadtree.h"
+
+#include <algorithm>
+#include <limits>
+
+bool QuadtreeNode::isLeaf() const
+{
+	return this->children[0] < 0 && this->children[1] < 0 && this->children[2] < 0 && this->children[3] < 0;
+}
+
+void PatchQuadtree::build(unsigned int gridSize, unsigned int leafSize)
+{
+	this->m_GridSize = gridSize;
+	this->m_LeafSize = leafSize;
+
+	this->m_Nodes.clear();
+	this->m_PatchOrder.clear();
+	this->m_PatchOrder.reserve(gridSize * gridSize);
+
+	if (gridSize > 0)
+	{
+		this->buildNode(0, 0, gridSize, gridSize);
+	}
+}
+
+int PatchQuadtree::buildNode(unsigned int x0, unsigned int z0, unsigned int x1, unsigned int z1)
+{
+	if (x0 >= x1 || z0 >= z1)
+	{
+		return -1;
+	}
+
+	int index = static_cast<int>(this->m_Nodes.size());
+	this->m_Nodes.push_back(QuadtreeNode {});
+
+	QuadtreeNode node {};
+	node.first = static_cast<unsigned int>(this->m_PatchOrder.size());
+	std::fill(node.children, node.children + 4, -1);
+
+	if (x1 - x0 <= this->m_LeafSize && z1 - z0 <= this->m_LeafSize)
+	{
+		for (unsigned int i = x0; i < x1; i++)
+		{
+			for (unsigned int j = z0; j < z1; j++)
+			{
+				this->m_PatchOrder.push_back(i * this->m_GridSize + j);
+			}
+		}
+	}
+	else
+	{
+		unsigned int xm = (x0 + x1 + 1) / 2;
+		unsigned int zm = (z0 + z1 + 1) / 2;
+
+		node.children[0] = this->buildNode(x0, z0, xm, zm);
+		node.children[1] = this->buildNode(xm, z0, x1, zm);
+		node.children[2] = this->buildNode(x0, zm, xm, z1);
+		node.children[3] = this->buildNode(xm, zm, x1, z1);
+	}
+
+	node.count = static_cast<unsigned int>(this->m_PatchOrder.size()) - node.first;
+	this->m_Nodes[index] = node;
+
+	return index;
+}
+
+void PatchQuadtree::updateBounds(const PatchBounds& bounds)
+{
+	// Children always come after their parent, so walking backwards visits them first
+	for (auto node = this->m_Nodes.rbegin(); node != this->m_Nodes.rend(); ++node)
+	{
+		node->minX = node->minY = node->minZ = std::numeric_limits<float>::max();
+		node->maxX = node->maxY = node->maxZ = std::numeric_limits<float>::lowest();
+
+		if (node->isLeaf())
+		{
+			for (unsigned int patch = node->first; patch < node->first + node->count; patch++)
+			{
+				node->minX = std::min(node->minX, bounds.minX[patch]);
+				node->minY = std::min(node->minY, bounds.minY[patch]);
+				node->minZ = std::min(node->minZ, bounds.minZ[patch]);
+				node->maxX = std::max(node->maxX, bounds.maxX[patch]);
+				node->maxY = std::max(node->maxY, bounds.maxY[patch]);
+				node->maxZ = std::max(node->maxZ, bounds.maxZ[patch]);
+			}
+			continue;
+		}
+
+		for (int child : node->children)
+		{
+			if (child < 0)
+			{
+				continue;
+			}
+
+			const QuadtreeNode& c = this->m_Nodes[child];
+			node->minX = std::min(node->minX, c.minX);
+			node->minY = std::min(node->minY, c.minY);
+			node->minZ = std::min(node->minZ, c.minZ);
+			node->maxX = std::max(node->maxX, c.maxX);
+			node->maxY = std::max(node->maxY, c.maxY);
+			node->maxZ = std::max(node->maxZ, c.maxZ);
+		}
+	}
+}
+
+const std::vector<unsigned int>& PatchQuadtree::getPatchOrder() const
+{
+	return this->m_PatchOrder;
+}
+
+int PatchQuadtree::findPatch(float x, float z, const PatchBounds& bounds) const
+{
+	auto contains = [x, z](float minX, float maxX, float minZ, float maxZ) {
+		return x >= minX && x <= maxX && z >= minZ && z <= maxZ;
+	};
+
+	if (this->m_Nodes.empty() || !contains(this->m_Nodes[0].minX, this->m_Nodes[0].maxX, this->m_Nodes[0].minZ, this->m_Nodes[0].maxZ))
+	{
+		return -1;
+	}
+
+	const QuadtreeNode* node = &this->m_Nodes[0];
+	while (!node->isLeaf())
+	{
+		const QuadtreeNode* next = nullptr;
+		for (int child : node->children)
+		{
+			if (child >= 0 && contains(this->m_Nodes[child].minX, this->m_Nodes[child].maxX, this->m_Nodes[child].minZ, this->m_Nodes[child].maxZ))
+			{
+				next = &this->m_Nodes[child];
+				break;
+			}
+		}
+
+		if (next == nullptr)
+		{
+			return -1;
+		}
+		node = next;
+	}
+
+	for (unsigned int patch = node->first; patch < node->first + node->count; patch++)
+	{
+		if (contains(bounds.minX[patch], bounds.maxX[patch], bounds.minZ[patch], bounds.maxZ[patch]))
+		{
+			return static_cast<int>(patch);
+		}
+	}
+
+	return -1;
+}
+
+const QuadtreeNode& PatchQuadtree::getNode(unsigned int node) const
+{
+	return this->m_Nodes[node];
+}
+
+unsigned int PatchQuadtree::getNodeCount() const
+{
+	return static_cast<unsigned int>(this->m_Nodes.size());
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "patch_bounds.h"
+
+struct QuadtreeNode
+{
+	// Range of patches covered by the node, patches are stored in quadtree order
+	unsigned int first;
+	unsigned int count;
+
+	// Index of the children nodes, -1 when absent
+	int children[4];
+
+	float minX, minY, minZ;
+	float maxX, maxY, maxZ;
+
+	bool isLeaf() const;
+};
+
+/*
+ * Quadtree over the patch grid. The patches are laid out in depth first order so
+ * every node covers a contiguous range of patches (and of vertices in the VBO)
+ */
+class PatchQuadtree
+{
+public:
+	void build(unsigned int gridSize, unsigned int leafSize);
+	void updateBounds(const PatchBounds& bounds);
+
+	/*
+	 * Grid cell (i * gridSize + j) of every patch, in quadtree order
+	 */
+	const std::vector<unsigned int>& getPatchOrder() const;
+
+	/*
+	 * Patch whose XZ bounds contain the point, -1 when outside the terrain
+	 */
+	int findPatch(float x, float z, const PatchBounds& bounds) const;
+
+	const QuadtreeNode& getNode(unsigned int node) const;
+	unsigned int getNodeCount() const;
+
+private:
+	std::vector<QuadtreeNode> m_Nodes;
+	std::vector<unsigned int> m_PatchOrder;
+
+	unsigned int m_GridSize;
+	unsigned int m_LeafSize;
+
+	int buildNode(unsigned int x0, unsigned int z0, unsigned int x1, unsigned int z1);
+};
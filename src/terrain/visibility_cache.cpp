@@ -0,0 +1,203 @@
+#include "visibility_cache.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "glm/geometric.hpp"
+
+// Frustum edge band and eye parallax allowed for a hidden chunk, as the sine of the angle seen from the eye
+static const float MAX_ANGLE = 0.05f;
+
+VisibilityCache::VisibilityCache(unsigned int revalidationInterval)
+	: m_RevalidationInterval(std::max(revalidationInterval, 1u))
+	, m_Stats { 0, 0, 0, 0, false, 0.0f }
+	, m_Frame(0)
+	, m_LastRevalidation(0)
+	, m_Valid(false)
+{
+}
+
+void VisibilityCache::split(const PatchQuadtree& quadtree, const Frustum& frustum, const glm::vec3& eye, unsigned int occluderVersion,
+	std::vector<unsigned int>& visible, std::vector<unsigned int>& retest)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	unsigned int patchCount = quadtree.getNodeCount() > 0 ? quadtree.getNode(0).count : 0;
+	if (this->m_PatchChunk.size() != patchCount)
+	{
+		this->buildChunks(quadtree);
+		this->m_Valid = false;
+	}
+
+	this->m_Frame++;
+
+	bool revalidate = !this->m_Valid || this->m_Frame - this->m_LastRevalidation >= this->m_RevalidationInterval;
+	if (revalidate)
+	{
+		this->m_LastRevalidation = this->m_Frame;
+		this->m_Valid = true;
+	}
+
+	retest.clear();
+	this->m_RetestChunks.clear();
+	this->m_Stats.chunks = 0;
+	this->m_Stats.reusedPatches = 0;
+	this->m_Stats.reusedHidden = 0;
+
+	// visible is ascending and every chunk is a contiguous range, so its patches come together
+	std::size_t kept = 0;
+	std::size_t k = 0;
+	while (k < visible.size())
+	{
+		unsigned int index = this->m_PatchChunk[visible[k]];
+		std::size_t end = k;
+		while (end < visible.size() && this->m_PatchChunk[visible[end]] == index)
+		{
+			end++;
+		}
+
+		Chunk& chunk = this->m_Chunks[index];
+		bool stale = revalidate
+			|| chunk.seenFrame != this->m_Frame - 1
+			|| (chunk.hidden && this->isStale(chunk, frustum, eye, occluderVersion));
+		chunk.seenFrame = this->m_Frame;
+		this->m_Stats.chunks++;
+
+		if (stale)
+		{
+			// Patches out of the frustum at the re-test must not keep an older result
+			std::fill(this->m_Hidden.begin() + chunk.first, this->m_Hidden.begin() + chunk.first + chunk.count, 0);
+			for (std::size_t p = k; p < end; p++)
+			{
+				this->m_Hidden[visible[p]] = 1;
+				retest.push_back(visible[p]);
+			}
+
+			chunk.testedEye = eye;
+			chunk.occluderVersion = occluderVersion;
+			this->m_RetestChunks.push_back(index);
+		}
+		else
+		{
+			std::size_t chunkKept = kept;
+			for (std::size_t p = k; p < end; p++)
+			{
+				if (this->m_Hidden[visible[p]] == 0)
+				{
+					visible[kept++] = visible[p];
+				}
+			}
+			this->m_Stats.reusedPatches += static_cast<unsigned int>(end - k);
+			this->m_Stats.reusedHidden += static_cast<unsigned int>(end - k - (kept - chunkKept));
+		}
+
+		k = end;
+	}
+	visible.resize(kept);
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_Stats.retested = static_cast<unsigned int>(this->m_RetestChunks.size());
+	this->m_Stats.revalidated = revalidate;
+	this->m_Stats.time = elapsed.count();
+}
+
+void VisibilityCache::merge(const std::vector<unsigned int>& retest, std::vector<unsigned int>& visible)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned int patch : retest)
+	{
+		this->m_Hidden[patch] = 0;
+	}
+
+	// The re-tested patches start hidden in split(), those still hidden were removed by the culling passes
+	for (unsigned int index : this->m_RetestChunks)
+	{
+		Chunk& chunk = this->m_Chunks[index];
+		chunk.hidden = false;
+		for (unsigned int patch = chunk.first; patch < chunk.first + chunk.count; patch++)
+		{
+			chunk.hidden = chunk.hidden || this->m_Hidden[patch] != 0;
+		}
+	}
+
+	this->m_Merged.resize(visible.size() + retest.size());
+	std::merge(visible.begin(), visible.end(), retest.begin(), retest.end(), this->m_Merged.begin());
+	visible.swap(this->m_Merged);
+
+	std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	this->m_Stats.time += elapsed.count();
+}
+
+void VisibilityCache::invalidate()
+{
+	this->m_Valid = false;
+}
+
+const VisibilityCacheStats& VisibilityCache::getStats() const
+{
+	return this->m_Stats;
+}
+
+void VisibilityCache::buildChunks(const PatchQuadtree& quadtree)
+{
+	this->m_Chunks.clear();
+
+	unsigned int patchCount = quadtree.getNodeCount() > 0 ? quadtree.getNode(0).count : 0;
+	this->m_PatchChunk.assign(patchCount, 0);
+	this->m_Hidden.assign(patchCount, 0);
+
+	for (unsigned int index = 0; index < quadtree.getNodeCount(); index++)
+	{
+		const QuadtreeNode& node = quadtree.getNode(index);
+		if (!node.isLeaf())
+		{
+			continue;
+		}
+
+		std::fill(this->m_PatchChunk.begin() + node.first, this->m_PatchChunk.begin() + node.first + node.count,
+			static_cast<unsigned int>(this->m_Chunks.size()));
+
+		this->m_Chunks.push_back({
+			node.first,
+			node.count,
+			glm::vec3(node.minX, node.minY, node.minZ),
+			glm::vec3(node.maxX, node.maxY, node.maxZ),
+			-1,
+			glm::vec3(0.0f),
+			0,
+			false });
+	}
+}
+
+bool VisibilityCache::isStale(const Chunk& chunk, const Frustum& frustum, const glm::vec3& eye, unsigned int occluderVersion) const
+{
+	if (chunk.occluderVersion != occluderVersion)
+	{
+		return true;
+	}
+
+	// Both limits widen with the distance, far chunks tolerate more eye travel and rotation
+	float band = MAX_ANGLE * glm::distance(eye, (chunk.minCorner + chunk.maxCorner) * 0.5f);
+	if (glm::distance(eye, chunk.testedEye) > band)
+	{
+		return true;
+	}
+
+	// Parts of the chunk out of the screen were never tested against the occluders
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		// Corner of the AABB closest to the outside of the plane
+		glm::vec3 corner(
+			plane.x >= 0.0f ? chunk.minCorner.x : chunk.maxCorner.x,
+			plane.y >= 0.0f ? chunk.minCorner.y : chunk.maxCorner.y,
+			plane.z >= 0.0f ? chunk.minCorner.z : chunk.maxCorner.z);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < band)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+
+#include "frustum_culler.h"
+#include "patch_quadtree.h"
+
+/*
+ * Counters of the last split() call
+ */
+struct VisibilityCacheStats
+{
+	unsigned int chunks;
+	unsigned int retested;
+	unsigned int reusedPatches;
+	unsigned int reusedHidden; // patches of the reused chunks kept out by an earlier horizon or occlusion test
+	bool revalidated;
+	float time; // microseconds
+};
+
+/*
+ * Keeps the horizon and occlusion results of every chunk (quadtree leaf) across
+ * frames, the frustum pass still runs on every frame. Reusing a chunk without hidden
+ * patches is always safe; the others are sent back to those passes when they get
+ * near a frustum edge, when the occluder set changes or when the eye moved enough
+ * to see them under another angle (both passes are invariant to camera rotation).
+ * Every chunk is re-validated every few frames and when it enters the frustum
+ */
+class VisibilityCache
+{
+public:
+	explicit VisibilityCache(unsigned int revalidationInterval);
+
+	/*
+	 * Takes the frustum visible patches and keeps in visible those of the reused
+	 * chunks that were not hidden, the patches to re-test are written to retest.
+	 * occluderVersion is the value returned by OcclusionCuller::selectOccluders
+	 */
+	void split(const PatchQuadtree& quadtree, const Frustum& frustum, const glm::vec3& eye, unsigned int occluderVersion,
+		std::vector<unsigned int>& visible, std::vector<unsigned int>& retest);
+
+	/*
+	 * Stores the patches of retest that survived the culling passes and merges them
+	 * into visible, which stays ascending
+	 */
+	void merge(const std::vector<unsigned int>& retest, std::vector<unsigned int>& visible);
+
+	/*
+	 * Forces a full re-validation on the next split(), for the frames culled without the cache
+	 */
+	void invalidate();
+
+	const VisibilityCacheStats& getStats() const;
+
+private:
+	struct Chunk
+	{
+		unsigned int first;
+		unsigned int count;
+		glm::vec3 minCorner;
+		glm::vec3 maxCorner;
+
+		// Last split() that saw the chunk in the frustum, eye and occluder set of its last re-test
+		long long seenFrame;
+		glm::vec3 testedEye;
+		unsigned int occluderVersion;
+		bool hidden;
+	};
+
+	unsigned int m_RevalidationInterval;
+	VisibilityCacheStats m_Stats;
+
+	long long m_Frame;
+	long long m_LastRevalidation;
+	bool m_Valid;
+
+	std::vector<Chunk> m_Chunks;
+	std::vector<unsigned int> m_PatchChunk;
+	std::vector<unsigned char> m_Hidden;
+	std::vector<unsigned int> m_RetestChunks;
+	std::vector<unsigned int> m_Merged;
+
+	void buildChunks(const PatchQuadtree& quadtree);
+	bool isStale(const Chunk& chunk, const Frustum& frustum, const glm::vec3& eye, unsigned int occluderVersion) const;
+};